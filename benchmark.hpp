@@ -0,0 +1,404 @@
+#pragma once
+
+#include "rtree.hpp"
+#include "temporal_blocks.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <chrono>
+
+/*
+Бенчмарк вставки в R-дерево
+Вставляет count случайных отрезков (как ребра дорожной сети) порциями по step штук
+и печатает пропускную способность каждой порции: при вставке за O(log n)
+число вставок в миллисекунду не должно падать по мере роста дерева
+*/
+inline void bench_ingest(size_t count, size_t step)
+{
+	using tree_t = R_tree<size_t, int, 2, float, 8, 4>;
+
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<int> coord(0, 1000000);
+	std::uniform_int_distribution<int> len(1, 500);
+
+	std::vector<tree_t::mbr_t> mbrs{};
+	mbrs.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		int x{ coord(gen) }, y{ coord(gen) };
+		mbrs.push_back(tree_t::mbr_t{ { x, y }, { x + len(gen), y + len(gen) } });
+	}
+
+	tree_t tree;
+	std::cout << "> Ingest benchmark: " << count << " inserts, step " << step << std::endl;
+	std::cout << std::right << std::setw(12) << "tree size" << std::setw(16) << "inserts/ms" << std::endl;
+	for (size_t done = 0; done < count; done += step)
+	{
+		size_t last{ std::min(count, done + step) };
+		auto start = std::chrono::high_resolution_clock::now();
+		for (size_t i = done; i < last; i++)
+		{
+			tree.insert(i, mbrs[i]);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+
+		double ms{ std::chrono::duration<double, std::milli>(end - start).count() };
+		std::cout << std::right << std::setw(12) << last << std::setw(16) << std::fixed << std::setprecision(1) << double(last - done) / ms << std::endl;
+	}
+}
+
+/*
+Сравнение построения R-дерева вставками и пакетной загрузкой (STR и Гильберт)
+Печатает время построения и время queries точечных запросов к каждому дереву
+*/
+inline void bench_bulk_load(size_t count, size_t queries)
+{
+	using tree_t = R_tree<size_t, int, 2, float, 8, 4>;
+
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<int> coord(0, 1000000);
+	std::uniform_int_distribution<int> len(1, 500);
+
+	std::vector<tree_t::entry_t> entries{};
+	entries.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		int x{ coord(gen) }, y{ coord(gen) };
+		entries.push_back({ i, tree_t::mbr_t{ { x, y }, { x + len(gen), y + len(gen) } } });
+	}
+	std::vector<tree_t::mbr_t> windows{};
+	for (size_t i = 0; i < queries; i++)
+	{
+		int x{ coord(gen) }, y{ coord(gen) };
+		windows.push_back(tree_t::mbr_t{ { x, y }, { x, y } });
+	}
+
+	auto run = [&](const char* name, tree_t& tree, double build_ms)
+	{
+		size_t found{};
+		auto start = std::chrono::high_resolution_clock::now();
+		for (const tree_t::mbr_t& w : windows)
+		{
+			found += tree.search_objects(w, [](size_t, void*) { return true; }, nullptr);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(14) << build_ms << std::setw(14) << std::chrono::duration<double, std::milli>(end - start).count()
+			<< std::setw(12) << found << std::endl;
+	};
+
+	std::cout << "> Bulk load benchmark: " << count << " objects, " << queries << " queries" << std::endl;
+	std::cout << std::left << std::setw(10) << "build" << std::right << std::setw(14) << "build, ms" << std::setw(14) << "queries, ms" << std::setw(12) << "found" << std::endl;
+	{
+		tree_t tree;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (const tree_t::entry_t& e : entries)
+		{
+			tree.insert(e.first, e.second);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		run("insert", tree, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	{
+		tree_t tree;
+		auto start = std::chrono::high_resolution_clock::now();
+		tree.bulk_load(entries);
+		auto end = std::chrono::high_resolution_clock::now();
+		run("STR", tree, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+	{
+		tree_t tree;
+		auto start = std::chrono::high_resolution_clock::now();
+		tree.bulk_load<R_hilbert_packing>(entries);
+		auto end = std::chrono::high_resolution_clock::now();
+		run("Hilbert", tree, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+}
+
+/*
+Сравнение политик вставки на пространственном уровне: квадратичное деление Гуттмана и R*
+Данные - отрезки дорожной сети (ломаные из длинных почти горизонтальных и вертикальных звеньев),
+запросы - точки на случайных отрезках; печатается время построения и среднее число узлов на запрос
+*/
+inline void bench_insert_policy(size_t count, size_t queries)
+{
+	using quadratic_t = R_tree<size_t, int, 2, float, 8, 4, R_quadratic_policy>;
+	using rstar_t = R_tree<size_t, int, 2, float, 8, 4, R_rstar_policy>;
+	using mbr_t = quadratic_t::mbr_t;
+
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<int> coord(0, 1000000);
+	std::uniform_int_distribution<int> step(50, 2000);
+	std::uniform_int_distribution<int> jitter(-20, 20);
+	std::uniform_int_distribution<int> turn(0, 3);
+	std::uniform_int_distribution<int> chain(5, 50);
+
+	std::vector<std::array<int, 4>> segments{};
+	segments.reserve(count);
+	while (segments.size() < count)
+	{
+		int x{ coord(gen) }, y{ coord(gen) };
+		for (int k = chain(gen); k > 0 && segments.size() < count; k--)
+		{
+			int dir{ turn(gen) }, len{ step(gen) };
+			int nx{ x + (dir == 0 ? len : dir == 1 ? -len : jitter(gen)) };
+			int ny{ y + (dir == 2 ? len : dir == 3 ? -len : jitter(gen)) };
+			segments.push_back({ x, y, nx, ny });
+			x = nx;
+			y = ny;
+		}
+	}
+	std::vector<mbr_t> mbrs{};
+	mbrs.reserve(count);
+	for (const std::array<int, 4>& s : segments)
+	{
+		mbrs.push_back(mbr_t{ { std::min(s[0], s[2]), std::min(s[1], s[3]) }, { std::max(s[0], s[2]), std::max(s[1], s[3]) } });
+	}
+	std::vector<mbr_t> windows{};
+	std::uniform_int_distribution<size_t> pick(0, count - 1);
+	std::uniform_real_distribution<double> along(0.0, 1.0);
+	for (size_t i = 0; i < queries; i++)
+	{
+		const std::array<int, 4>& s{ segments[pick(gen)] };
+		double t{ along(gen) };
+		int x{ int(s[0] + t * (s[2] - s[0])) }, y{ int(s[1] + t * (s[3] - s[1])) };
+		windows.push_back(mbr_t{ { x, y }, { x, y } });
+	}
+
+	auto run = [&](const char* name, auto& tree)
+	{
+		using tree_t = std::remove_reference_t<decltype(tree)>;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < count; i++)
+		{
+			tree.insert(i, typename tree_t::mbr_t{ mbrs[i].ld, mbrs[i].ru });
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+
+		size_t visits{}, found{};
+		for (const mbr_t& w : windows)
+		{
+			typename tree_t::mbr_t q{ w.ld, w.ru };
+			visits += tree.count_visits(mbr_test::covers, q);
+			found += tree.search_objects(q, [](size_t, void*) { return true; }, nullptr);
+		}
+		std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(14) << std::chrono::duration<double, std::milli>(end - start).count()
+			<< std::setw(16) << double(visits) / double(windows.size())
+			<< std::setw(12) << found << std::endl;
+	};
+
+	std::cout << "> Insert policy benchmark: " << count << " road segments, " << queries << " point queries" << std::endl;
+	std::cout << std::left << std::setw(12) << "policy" << std::right << std::setw(14) << "build, ms" << std::setw(16) << "nodes/query" << std::setw(12) << "found" << std::endl;
+	{
+		quadratic_t tree;
+		run("quadratic", tree);
+	}
+	{
+		rstar_t tree;
+		run("R*", tree);
+	}
+}
+
+/*
+Вставка во временное (одномерное) дерево с разными политиками деления и в блочный индекс (Temporal_blocks)
+Интервалы идут почти по порядку времени, как сегменты траекторий на одном ребре;
+печатается число вставок в миллисекунду, среднее число узлов (блоков) на точечный запрос
+и число точечных запросов в миллисекунду
+*/
+inline void bench_temporal_ingest(size_t count, size_t queries)
+{
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> gap(0.0, 2.0);
+	std::uniform_real_distribution<double> duration(0.5, 30.0);
+	std::uniform_int_distribution<int> late(0, 19);
+
+	std::vector<std::pair<double, double>> intervals{};
+	intervals.reserve(count);
+	double t{};
+	for (size_t i = 0; i < count; i++)
+	{
+		t += gap(gen);
+		double t_in{ late(gen) == 0 ? t - duration(gen) * 10 : t }; /*каждый 20-й сегмент приходит с опозданием*/
+		intervals.push_back({ t_in, t_in + duration(gen) });
+	}
+	std::vector<double> points{};
+	std::uniform_real_distribution<double> when(0.0, t);
+	for (size_t i = 0; i < queries; i++)
+	{
+		points.push_back(when(gen));
+	}
+
+	auto run = [&](const char* name, auto& tree)
+	{
+		using tree_t = std::remove_reference_t<decltype(tree)>;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < count; i++)
+		{
+			tree.insert(i, typename tree_t::mbr_t{ { intervals[i].first }, { intervals[i].second } });
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+
+		size_t visits{};
+		for (double p : points)
+		{
+			visits += tree.count_visits(mbr_test::covers, typename tree_t::mbr_t{ { p }, { p } });
+		}
+
+		size_t found{};
+		auto start2 = std::chrono::high_resolution_clock::now();
+		for (double p : points)
+		{
+			found += tree.search(mbr_test::covers, typename tree_t::mbr_t{ { p }, { p } }, [](const size_t&) { return true; });
+		}
+		auto end2 = std::chrono::high_resolution_clock::now();
+
+		double ms{ std::chrono::duration<double, std::milli>(end - start).count() };
+		double query_ms{ std::chrono::duration<double, std::milli>(end2 - start2).count() };
+		std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(16) << double(count) / ms
+			<< std::setw(16) << double(visits) / double(points.size())
+			<< std::setw(16) << double(points.size()) / query_ms
+			<< std::setw(12) << found << std::endl;
+	};
+
+	std::cout << "> Temporal ingest benchmark: " << count << " intervals, " << queries << " point queries" << std::endl;
+	std::cout << std::left << std::setw(12) << "policy" << std::right << std::setw(16) << "inserts/ms" << std::setw(16) << "nodes/query"
+		<< std::setw(16) << "queries/ms" << std::setw(12) << "found" << std::endl;
+	{
+		R_tree<size_t, double, 1, float, 8, 4, R_quadratic_policy> tree;
+		run("quadratic", tree);
+	}
+	{
+		R_tree<size_t, double, 1, float, 8, 4, R_linear_policy> tree;
+		run("linear", tree);
+	}
+	{
+		R_tree<size_t, double, 1, float, 8, 4, R_sorted_policy> tree;
+		run("sorted", tree);
+	}
+	{
+		Temporal_blocks<size_t, double, float> tree;
+		run("blocks", tree);
+	}
+}
+
+/*
+Замороженное дерево против изменяемого: память (size) и время точечных запросов
+Дерево строится вставками из случайных отрезков, затем замораживается (R_tree::freeze)
+*/
+inline void bench_freeze(size_t count, size_t queries)
+{
+	using tree_t = R_tree<size_t, int, 2, float, 8, 4>;
+
+	std::mt19937 gen(42);
+	std::uniform_int_distribution<int> coord(0, 1000000);
+	std::uniform_int_distribution<int> len(1, 500);
+
+	tree_t tree;
+	for (size_t i = 0; i < count; i++)
+	{
+		int x{ coord(gen) }, y{ coord(gen) };
+		tree.insert(i, tree_t::mbr_t{ { x, y }, { x + len(gen), y + len(gen) } });
+	}
+	std::vector<tree_t::mbr_t> windows{};
+	for (size_t i = 0; i < queries; i++)
+	{
+		int x{ coord(gen) }, y{ coord(gen) };
+		windows.push_back(tree_t::mbr_t{ { x, y }, { x, y } });
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	auto frozen = tree.freeze();
+	auto end = std::chrono::high_resolution_clock::now();
+	double freeze_ms{ std::chrono::duration<double, std::milli>(end - start).count() };
+
+	auto run = [&](const char* name, const auto& searched, size_t bytes)
+	{
+		size_t found{};
+		auto start = std::chrono::high_resolution_clock::now();
+		for (const tree_t::mbr_t& w : windows)
+		{
+			found += searched.search_objects({ w.ld, w.ru }, [](const size_t&) { return true; });
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(16) << bytes << std::setw(14) << std::chrono::duration<double, std::milli>(end - start).count()
+			<< std::setw(12) << found << std::endl;
+	};
+
+	std::cout << "> Freeze benchmark: " << count << " objects, " << queries << " queries, freeze " << std::fixed << std::setprecision(1) << freeze_ms << " ms" << std::endl;
+	std::cout << std::left << std::setw(10) << "tree" << std::right << std::setw(16) << "memory, bytes" << std::setw(14) << "queries, ms" << std::setw(12) << "found" << std::endl;
+	run("mutable", tree, tree.size([](const size_t&) { return size_t(0); }));
+	run("frozen", frozen, frozen.size());
+}
+
+/*
+Удаление устаревших интервалов из временного дерева: по одному (remove), пакетом (remove_batch)
+и по условию с окном (remove_if); удаляется старшая половина интервалов, печатается число удалений в миллисекунду
+*/
+inline void bench_remove(size_t count)
+{
+	using tree_t = R_tree<size_t, double, 1, float, 8, 4, R_sorted_policy>;
+
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<double> gap(0.0, 2.0);
+	std::uniform_real_distribution<double> duration(0.5, 30.0);
+
+	std::vector<tree_t::entry_t> items{};
+	items.reserve(count);
+	double t{};
+	for (size_t i = 0; i < count; i++)
+	{
+		t += gap(gen);
+		items.push_back({ i, tree_t::mbr_t{ { t }, { t + duration(gen) } } });
+	}
+	const size_t stale{ count / 2 };
+	const double cutoff{ items[stale].second.ld[0] };
+	std::vector<tree_t::entry_t> old_items{};
+	for (const tree_t::entry_t& item : items)
+	{
+		if (item.second.ru[0] < cutoff)
+			old_items.push_back(item);
+	}
+
+	auto run = [&](const char* name, auto&& remove)
+	{
+		tree_t tree;
+		for (const tree_t::entry_t& item : items)
+		{
+			tree.insert(item.first, item.second);
+		}
+		auto start = std::chrono::high_resolution_clock::now();
+		remove(tree);
+		auto end = std::chrono::high_resolution_clock::now();
+
+		size_t left{ tree.search_intersecting(tree_t::mbr_t{ { 0.0 }, { t + 100.0 } }, [](const size_t&) { return true; }) };
+		double ms{ std::chrono::duration<double, std::milli>(end - start).count() };
+		std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(16) << double(old_items.size()) / ms << std::setw(12) << left << std::endl;
+	};
+
+	std::cout << "> Remove benchmark: " << count << " intervals, " << old_items.size() << " stale" << std::endl;
+	std::cout << std::left << std::setw(12) << "method" << std::right << std::setw(16) << "removes/ms" << std::setw(12) << "left" << std::endl;
+	run("remove", [&](tree_t& tree)
+		{
+			for (const tree_t::entry_t& item : old_items)
+			{
+				tree.remove(item.second, item.first);
+			}
+		});
+	run("batch", [&](tree_t& tree)
+		{
+			tree.remove_batch(old_items);
+		});
+	run("remove_if", [&](tree_t& tree)
+		{
+			tree.remove_if(mbr_test::inside, tree_t::mbr_t{ { 0.0 }, { cutoff } }, [&](const size_t& id)
+				{
+					return items[id].second.ru[0] < cutoff;
+				});
+		});
+}
@@ -1,23 +1,67 @@
 #pragma once
 
 #include "rtree.hpp"
+#include "temporal_blocks.hpp"
 
 #include "line.hpp"
 #include "interval.hpp"
+#include "thread_pool.hpp"
+#include "mapped_file.hpp"
 
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <set>
+#include <vector>
+#include <array>
+#include <queue>
+#include <limits>
+#include <utility>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <unordered_map>
+#include <cstring>
 
 //#define DEBUG
 
-template <typename object_t>
+/*
+Временной индекс ребра (параметр temporal_policy FNR_tree): tree_t<объект, stats_policy> - тип индекса
+-FNR_rtree_temporal - одномерное R-дерево с делением по отсортированным интервалам (по умолчанию)
+-FNR_blocked_temporal - блоки интервалов по возрастанию времени входа (temporal_blocks.hpp): перемещения
+ приходят почти по порядку времени, вставка по порядку - дописывание в последний блок
+*/
+struct FNR_rtree_temporal
+{
+	template<typename data_type, typename stats_policy>
+	using tree_t = R_tree<data_type, double, 1, float, 8, 4, R_sorted_policy, stats_policy>;
+};
+struct FNR_blocked_temporal
+{
+	template<typename data_type, typename stats_policy>
+	using tree_t = Temporal_blocks<data_type, double, float, 64, stats_policy>;
+};
+
+/*
+FNR-дерево
+Поисковые функции (search, search_batch, search_parallel, query, nearest_objects) константные,
+все состояние поиска хранится в самом вызове: их можно выполнять одновременно из нескольких потоков,
+пока дерево не изменяется
+insert_trip_segment можно вызывать одновременно из нескольких потоков: пространственный уровень, хеш отрезков
+и массив ребер при этом только читаются, временное дерево каждого ребра защищено своей блокировкой; вставка ребер (insert_line,
+load_network) и поиск одновременно с ней не допускаются
+stats_policy - статистика обходов пространственного и временных деревьев (R_no_stats или R_count_stats, см. rtree_stats.hpp)
+temporal_policy - временной индекс ребра (FNR_rtree_temporal или FNR_blocked_temporal)
+*/
+template <typename object_t, typename stats_policy = R_no_stats, typename temporal_policy = FNR_rtree_temporal>
 class FNR_tree
 {
-private:
+public:
 	class Spatial_leaf;
 	class Temporal_leaf;
-	using spatial_t = R_tree<std::shared_ptr<Spatial_leaf>, int, 2, float, 8, 4>;
+private:
+	using spatial_t = R_tree<std::shared_ptr<Spatial_leaf>, int, 2, float, 8, 4, R_quadratic_policy, stats_policy>;
 	using spatial_level_t = std::shared_ptr<spatial_t>;
 
 public:
@@ -56,6 +100,10 @@ public:
 		{
 			return this->interval;
 		}
+		bool get_direction() const
+		{
+			return this->movement_direction;
+		}
 		size_t size() const
 		{
 			return sizeof(Temporal_leaf);
@@ -70,7 +118,8 @@ public:
 	class Spatial_leaf
 	{
 	public:
-		using temporal_t = R_tree<std::shared_ptr<Temporal_leaf>, double, 1, float>;
+		/*временные интервалы добавляются почти по порядку: индекс выбирается политикой temporal_policy*/
+		using temporal_t = typename temporal_policy::template tree_t<std::shared_ptr<Temporal_leaf>, stats_policy>;
 		using temporal_ptr_t = std::shared_ptr<temporal_t>;
 
 		Spatial_leaf() = default;
@@ -106,6 +155,26 @@ public:
 		{
 			return this->temporal_tree;
 		}
+		/*вставка перемещения во временное дерево под блокировкой ребра*/
+		void insert_interval(std::shared_ptr<Temporal_leaf> leaf)
+		{
+			const Interval& interval{ leaf->get_interval() };
+			std::lock_guard<std::mutex> lock(this->temporal_mutex);
+			this->temporal_tree->insert(std::move(leaf), { interval.time_in, interval.time_out });
+		}
+		/*
+		удаление за один проход перемещений, интервалы которых удовлетворяют проверке test с окном window
+		и для которых predicate(const Temporal_leaf&) истинно; возвращает число удаленных
+		*/
+		template<typename predicate_t>
+		size_t remove_intervals(mbr_test test, const Interval& window, predicate_t&& predicate)
+		{
+			std::lock_guard<std::mutex> lock(this->temporal_mutex);
+			return this->temporal_tree->remove_if(test, { { window.time_in }, { window.time_out } }, [&predicate](const std::shared_ptr<Temporal_leaf>& leaf)
+				{
+					return predicate(*leaf);
+				});
+		}
 		size_t size() const
 		{
 			size_t self{ sizeof(Spatial_leaf) };
@@ -118,11 +187,31 @@ public:
 	private:
 		bool orientation;
 		temporal_ptr_t temporal_tree;
+		std::mutex temporal_mutex{}; /*блокировка временного дерева при одновременной вставке*/
 		Line line;
 		std::string nnn;
 
 	};
 
+	/*идентификатор ребра не задан (как и любой отрицательный): ребро доступно только по отрезку*/
+	static constexpr long long no_edge{ -1 };
+
+	/*ребро дорожной сети для пакетной загрузки*/
+	struct Network_edge
+	{
+	public:
+		int x1, y1, x2, y2;
+		std::string name;
+		long long id{ no_edge };
+
+		Network_edge() = default;
+		~Network_edge() = default;
+		Network_edge(int x1, int y1, int x2, int y2, std::string name)
+			: x1(x1), y1(y1), x2(x2), y2(y2), name(name) {}
+		Network_edge(long long id, int x1, int y1, int x2, int y2, std::string name)
+			: x1(x1), y1(y1), x2(x2), y2(y2), name(name), id(id) {}
+	};
+
 	/*структуры передаваемых аргументов*/
 	struct Insert_interval_args
 	{
@@ -149,18 +238,207 @@ public:
 		Line s_window;
 		Interval t_window;
 		std::set<object_t>* result_array;
-		std::shared_ptr<Spatial_leaf> lf;
+		const Spatial_leaf* lf{ nullptr };
+		mbr_test t_test{ mbr_test::inside };
+		R_stats* t_stats{ nullptr };
 
 		Search_args() = default;
 		~Search_args() = default;
-		Search_args(Line l, Interval i, std::set<object_t>* r)
+		Search_args(Line l, Interval i, std::set<object_t>* r, mbr_test t)
 		{
 			s_window = l;
 			t_window = i;
 			result_array = r;
+			t_test = t;
 		};
 	};
 
+	/*статистика поиска по уровням (при stats_policy = R_count_stats): пространственное дерево и все просмотренные временные*/
+	struct Search_stats
+	{
+	public:
+		R_stats spatial;
+		R_stats temporal;
+
+		Search_stats& operator+=(const Search_stats& other)
+		{
+			this->spatial += other.spatial;
+			this->temporal += other.temporal;
+			return *this;
+		}
+	};
+
+	/*
+	форма дерева: пространственный уровень, все временные деревья вместе (уровни совмещены от листьев)
+	и распределение перемещений по ребрам
+	*/
+	struct Tree_shape
+	{
+	public:
+		R_shape spatial;
+		R_shape temporal;
+		/*ребра и перемещения на них*/
+		size_t edges{};
+		size_t intervals{};
+		/*ребра по числу перемещений: histogram[0] - без перемещений, histogram[k] - от 2^(k-1) до 2^k - 1*/
+		std::vector<size_t> histogram;
+		/*ребра с наибольшими временными деревьями и число перемещений на них, по убыванию*/
+		std::vector<std::pair<const Spatial_leaf*, size_t>> largest;
+	};
+
+	/*запрос пакетного поиска: пространственное окно и временное окно*/
+	struct Search_query
+	{
+	public:
+		int x1, y1, x2, y2;
+		double entrance_time, exit_time;
+
+		Search_query() = default;
+		~Search_query() = default;
+		Search_query(int x1, int y1, int x2, int y2, double entranceTime, double exitTime)
+			: x1(x1), y1(y1), x2(x2), y2(y2), entrance_time(entranceTime), exit_time(exitTime) {}
+	};
+
+	/*
+	образ дерева (save_image, Frozen_FNR_tree): заголовок, образы временных деревьев и имена ребер,
+	затем образ пространственного дерева; смещения - от начала образа
+	*/
+	struct Frozen_header
+	{
+	public:
+		uint32_t magic;
+		uint32_t version;
+		uint32_t object_size;
+		uint32_t reserved;
+		uint64_t spatial;
+		uint64_t bytes;
+	};
+	/*ребро в образе: отрезок, ориентация, имя и образ временного дерева*/
+	struct Frozen_edge
+	{
+	public:
+		Line line;
+		uint32_t orientation;
+		uint32_t name_size;
+		uint64_t name;
+		uint64_t temporal;
+	};
+	/*перемещение в образе*/
+	struct Frozen_move
+	{
+	public:
+		object_t object_id;
+		Interval interval;
+		uint32_t direction;
+	};
+	static constexpr uint32_t frozen_fnr_magic{ 0x49524E46 }; /*"FNRI"*/
+
+	/*результат курсора запроса: объект, ребро, по которому он двигался, и интервал движения*/
+	struct Query_hit
+	{
+	public:
+		object_t object_id;
+		const Spatial_leaf* edge;
+		Interval interval;
+	};
+
+	/*
+	ленивый курсор запроса: перемещения выдаются по одному при каждом next(),
+	обход пространственного и временных деревьев ведется по явным стекам;
+	объект выдается столько раз, сколько у него подходящих перемещений;
+	курсор действителен, пока дерево не изменяется
+	*/
+	class Query_cursor
+	{
+	public:
+		class iterator
+		{
+		public:
+			using iterator_category = std::input_iterator_tag;
+			using value_type = Query_hit;
+			using difference_type = std::ptrdiff_t;
+			using pointer = const Query_hit*;
+			using reference = const Query_hit&;
+
+			iterator() = default;
+			explicit iterator(Query_cursor* cursor)
+				: cursor(cursor) {}
+
+			reference operator*() const { return this->cursor->get(); }
+			pointer operator->() const { return &this->cursor->get(); }
+			iterator& operator++()
+			{
+				if (!this->cursor->next())
+					this->cursor = nullptr;
+				return *this;
+			}
+			bool operator==(const iterator& other) const { return this->cursor == other.cursor; }
+			bool operator!=(const iterator& other) const { return this->cursor != other.cursor; }
+
+		private:
+			Query_cursor* cursor{ nullptr };
+		};
+
+		Query_cursor() = default;
+
+		/*переход к следующему перемещению, false - перемещений больше нет*/
+		bool next()
+		{
+			this->started = true;
+			while (true)
+			{
+				if (this->in_edge && this->temporal.next())
+				{
+					const Temporal_leaf& leaf{ *this->temporal.data() };
+					this->hit = Query_hit{ leaf.get_id(), this->edge, leaf.get_interval() };
+					return true;
+				}
+				this->in_edge = false;
+				if (!this->spatial.next())
+				{
+					this->edge = nullptr;
+					return false;
+				}
+				const Spatial_leaf* lf{ this->spatial.data().get() };
+				if (!edge_intersect_window(*lf, this->s_window)) /*ребро не проходит через окно: временное дерево не просматривается*/
+					continue;
+				this->edge = lf;
+				this->temporal.open(*lf->get_temporal_tree(), this->t_test, { this->t_window.time_in, this->t_window.time_out });
+				this->in_edge = true;
+			}
+		}
+
+		/*текущее перемещение (после успешного next())*/
+		const Query_hit& get() const
+		{
+			return this->hit;
+		}
+
+		iterator begin()
+		{
+			if (!this->started)
+				this->next();
+			return this->edge ? iterator(this) : iterator();
+		}
+		iterator end()
+		{
+			return iterator();
+		}
+
+	private:
+		friend class FNR_tree;
+
+		typename spatial_t::query_cursor spatial{};
+		typename Spatial_leaf::temporal_t::query_cursor temporal{};
+		const Spatial_leaf* edge{ nullptr };
+		bool in_edge{ false };
+		bool started{ false };
+		Line s_window{};
+		Interval t_window{};
+		mbr_test t_test{ mbr_test::inside };
+		Query_hit hit{};
+	};
+
 	/*печать дерева в консоль*/
 	void print() const
 	{
@@ -187,32 +465,79 @@ public:
 		std::cout << "> BEGIN InsertLine name: " + name + ":" << std::endl;
 #endif // DEBUG
 
-		bool ori = !((x2 - x1) * (y2 - y1) >= 0); // 0 -> / , 1 -> \ .
-		Line tmpLine(std::min(x1, x2), std::min(y1, y2), std::max(x1, x2), std::max(y1, y2));
+		typename spatial_t::entry_t entry{ make_spatial_entry(x1, y1, x2, y2, name) };
 
 #ifdef DEBUG
-		std::cout << "\t> Inserting.. (" << tmpLine.min[0] << "," << tmpLine.min[1] << ")->(" << tmpLine.max[0] << "," << tmpLine.max[1] << ")" << std::endl;
+		std::cout << "\t> Inserting.. (" << entry.second.ld[0] << "," << entry.second.ld[1] << ")->(" << entry.second.ru[0] << "," << entry.second.ru[1] << ")" << std::endl;
 #endif // DEBUG
 
-		auto tmp_leaf = std::make_shared<Spatial_leaf>(tmpLine, ori, name);
-		spatial_level->insert(tmp_leaf, { tmpLine.min, tmpLine.max });
+		spatial_level->insert(entry.first, entry.second);
+		this->index_line(entry.first);
 #ifdef DEBUG
 		std::cout << "> END   InsertLine." << std::endl;
 #endif // DEBUG
 	}
 
+	/*
+	Вставка именованного отрезка с идентификатором ребра
+	Перемещения по ребру можно вставлять по идентификатору (insert_trip_segment с edge_id):
+	хеш по идентификатору хранит сам лист ребра, поэтому идентификаторы могут быть любыми неотрицательными;
+	отрицательный идентификатор не индексируется, при повторном остается первое ребро (как в хеше отрезков)
+	Аргументы:
+	-Идентификатор ребра
+	-Начало отрезка
+	-Конец отрезка
+	-Название
+	*/
+	void insert_line(long long edge_id, int x1, int y1, int x2, int y2, std::string name)
+	{
+		typename spatial_t::entry_t entry{ make_spatial_entry(x1, y1, x2, y2, name) };
+
+		spatial_level->insert(entry.first, entry.second);
+		this->index_line(entry.first);
+		this->index_edge(edge_id, entry.first);
+	}
+
+	/*
+	Загрузка всей дорожной сети за один проход
+	Пространственный уровень строится упаковкой (по умолчанию STR, см. rtree_packing.hpp),
+	уже вставленные отрезки сохраняются
+	Аргументы:
+	-Ребра сети
+	*/
+	template<typename packing_t = R_str_packing>
+	void load_network(const std::vector<Network_edge>& edges)
+	{
+#ifdef DEBUG
+		std::cout << "> BEGIN LoadNetwork: " << edges.size() << " edges." << std::endl;
+#endif // DEBUG
+
+		std::vector<typename spatial_t::entry_t> entries{};
+		entries.reserve(edges.size());
+		for (const Network_edge& edge : edges)
+		{
+			entries.push_back(make_spatial_entry(edge.x1, edge.y1, edge.x2, edge.y2, edge.name));
+			this->index_line(entries.back().first);
+			this->index_edge(edge.id, entries.back().first);
+		}
+		spatial_level->template bulk_load<packing_t>(entries);
+
+#ifdef DEBUG
+		std::cout << "> END   LoadNetwork." << std::endl;
+#endif // DEBUG
+	}
+
 	/*вставка временного интервала, вызывается в r-tree, передается: куда и что (Insert_interval_args)*/
-	static bool insert_time_interval(std::shared_ptr<Spatial_leaf> id, void* arg)
+	static bool insert_time_interval(const std::shared_ptr<Spatial_leaf>& id, const Insert_interval_args& args)
 	{
 #ifdef DEBUG
 		std::cout << "\t> TRYING InsertTimeInterval..." << std::endl;
 #endif // DEBUG
 
-		Insert_interval_args* args = (Insert_interval_args*)arg;
-		object_t object_id = args->object_id;
-		Line targetLine = args->line;
-		Line line = id->get_line();
-		bool orientation = args->orientation;
+		object_t object_id = args.object_id;
+		const Line& targetLine = args.line;
+		const Line& line = id->get_line();
+		bool orientation = args.orientation;
 
 		if (!targetLine.equals(line)) 
 			return true;
@@ -221,7 +546,7 @@ public:
 		std::cout << "\t> BEGIN InsertTimeInterval." << std::endl;
 #endif // DEBUG
 
-		Interval tmpInterval = args->time_interval;
+		Interval tmpInterval = args.time_interval;
 
 #ifdef DEBUG
 		std::string arrow = orientation ? "<--" : "-->";
@@ -230,7 +555,7 @@ public:
 
 		
 		std::shared_ptr<Temporal_leaf> tmpLeaf = std::make_shared<Temporal_leaf>(tmpInterval, object_id, orientation);
-		id->get_temporal_tree()->insert(tmpLeaf, { tmpInterval.time_in, tmpInterval.time_out });
+		id->insert_interval(std::move(tmpLeaf));
 
 #ifdef DEBUG
 		std::cout << "\t> END   InsertTimeInterval." << std::endl;
@@ -267,13 +592,67 @@ public:
 #endif // !DEBUG
 
 
-		this->spatial_level->search_objects({ tmpLine.min, tmpLine.max }, this->insert_time_interval, (void*)&args);
+		/*ребро по отрезку - одним поиском в хеше, без спуска по пространственному уровню*/
+		auto edge = this->lines.find(tmpLine);
+		if (edge != this->lines.end())
+		{
+			insert_time_interval(edge->second, args);
+		}
 
 #ifdef DEBUG
 		std::cout << "> END InsertTripSegment." << std::endl;
 #endif // DEBUG
 	}
 
+	/*
+	Вставка перемещения по идентификатору ребра (ребро вставлено insert_line или load_network с идентификатором),
+	без поиска по геометрии; перемещения по неизвестным ребрам пропускаются
+	Аргументы:
+	-Перемещающийся объект
+	-Идентификатор ребра
+	-Время выхода
+	-Время прихода
+	-Направление движения: false - от меньшей координаты x (при вертикальном ребре - y) к большей, true - обратно
+	*/
+	void insert_trip_segment(object_t object_id, long long edge_id, double entrance_time, double exit_time, bool direction)
+	{
+		auto edge = this->edges.find(edge_id);
+		if (edge != this->edges.end())
+		{
+			edge->second->insert_interval(std::make_shared<Temporal_leaf>(Interval(entrance_time, exit_time), object_id, direction));
+		}
+	}
+
+	/*
+	Удаление всех перемещений объекта
+	Аргументы:
+	-Перемещающийся объект
+	Возвращает число удаленных перемещений
+	*/
+	size_t remove_object(const object_t& object_id)
+	{
+		constexpr double lowest{ std::numeric_limits<double>::lowest() }, highest{ std::numeric_limits<double>::max() };
+		return this->remove_trip_segments(mbr_test::intersects, Interval(lowest, highest), [&object_id](const Temporal_leaf& leaf)
+			{
+				return leaf.get_id() == object_id;
+			});
+	}
+
+	/*
+	Удаление устаревших перемещений
+	Аргументы:
+	-Момент отсечения: удаляются перемещения, закончившиеся раньше него
+	Возвращает число удаленных перемещений
+	*/
+	size_t remove_before(double cutoff)
+	{
+		constexpr double lowest{ std::numeric_limits<double>::lowest() };
+		return this->remove_trip_segments(mbr_test::inside, Interval(lowest, cutoff), [cutoff](const Temporal_leaf& leaf)
+			{
+				return leaf.get_interval().time_out < cutoff;
+			});
+	}
+
 	/*
 	Пересекает ли сегмент прямоугольник
 	*/
@@ -335,35 +714,48 @@ public:
 		return true;
 	}
 
+	/*Концы отрезка ребра (p1X, p1Y, p2X, p2Y), восстановленные по mbr и ориентации*/
+	static std::array<int, 4> edge_segment(const Line& lSeg, bool orientation)
+	{
+		if (orientation)
+			return { lSeg.min[0], lSeg.max[1], lSeg.max[0], lSeg.min[1] };
+		return { lSeg.min[0], lSeg.min[1], lSeg.max[0], lSeg.max[1] };
+	}
+	static std::array<int, 4> edge_segment(const Spatial_leaf& edge)
+	{
+		return edge_segment(edge.get_line(), edge.get_orientation());
+	}
+
+	/*Проходит ли отрезок ребра через пространственное окно*/
+	static bool edge_intersect_window(const Spatial_leaf& edge, const Line& sBox)
+	{
+		std::array<int, 4> p{ edge_segment(edge) };
+		return segment_intersect_rectangle(sBox.min[0], sBox.min[1], sBox.max[0], sBox.max[1], p[0], p[1], p[2], p[3]);
+	}
+
+	/*Расстояние от точки до отрезка ребра*/
+	static double edge_distance(const Spatial_leaf& edge, int x, int y)
+	{
+		std::array<int, 4> p{ edge_segment(edge) };
+		double dx = double(p[2]) - p[0], dy = double(p[3]) - p[1];
+		double len2 = dx * dx + dy * dy;
+		double t = len2 > 0 ? ((double(x) - p[0]) * dx + (double(y) - p[1]) * dy) / len2 : 0.0;
+		t = std::max(0.0, std::min(1.0, t));
+		double ex = p[0] + t * dx - x, ey = p[1] + t * dy - y;
+		return std::sqrt(ex * ex + ey * ey);
+	}
+
 	/*Внутренний поиск, если пересекаются линия поиска и то, что лежит в дереве, то id добавляется в результирующий список*/
-	static bool aux_temporal_search(std::shared_ptr<Temporal_leaf> id, void* arg)
+	static bool aux_temporal_search(const std::shared_ptr<Temporal_leaf>& id, const Search_args& args)
 	{
 #ifdef DEBUG
 		std::cout << "\t> BEGIN auxTemporalSearch." << std::endl;
 		std::cout << " \t\tFound: " << id->get_id() << " -> [" << id->get_interval().time_in << ", " << id->get_interval().time_out << "]" << std::endl;
 #endif // DEBUG
 
-		Search_args* args = (Search_args*)arg;
-		Line sBox = args->s_window;
-		Line lSeg = args->lf->get_line();
-		bool ori = args->lf->get_orientation();
-
-		int p1X, p1Y, p2X, p2Y;
-		if (ori)
+		if (edge_intersect_window(*args.lf, args.s_window))
 		{
-			p1X = lSeg.min[0]; p1Y = lSeg.max[1];
-			p2X = lSeg.max[0]; p2Y = lSeg.min[1];
-		}
-		else
-		{
-			p1X = lSeg.min[0]; p1Y = lSeg.min[1];
-			p2X = lSeg.max[0]; p2Y = lSeg.max[1];
-		}
-
-		if (segment_intersect_rectangle(sBox.min[0], sBox.min[1], sBox.max[0], sBox.max[1], p1X, p1Y, p2X, p2Y))
-		{
-			std::set<object_t>* resultArray = args->result_array;
-			resultArray->insert(id->get_id());
+			args.result_array->insert(id->get_id());
 		}
 
 #ifdef DEBUG
@@ -374,22 +766,26 @@ public:
 	}
 
 	/*Внутренний поиск, ищем по временному окну в одномерном дереве*/
-	static bool aux_spatial_search(std::shared_ptr<Spatial_leaf> id, void* arg)
+	static bool aux_spatial_search(const std::shared_ptr<Spatial_leaf>& id, Search_args& args)
 	{
 #ifdef DEBUG
 		std::cout << "\t> BEGIN auxSpatialSearch." << std::endl;
 		std::cout << "\t\t" << id->get_name() << std::endl;
 #endif // DEBUG
 			
-		Search_args* args = (Search_args*)arg;
-		Interval temporalWindow = args->t_window;
-		args->lf = id;
+		Interval temporalWindow = args.t_window;
+		args.lf = id.get();
 
 #ifdef DEBUG
 		std::cout << "\t-> interval = [" << temporalWindow.time_in << ", " << temporalWindow.time_out << "]" << std::endl;
 #endif // DEBUG
 
-		id->get_temporal_tree()->search_in_range({ temporalWindow.time_in, temporalWindow.time_out }, aux_temporal_search, arg);
+		id->get_temporal_tree()->search(args.t_test, { temporalWindow.time_in, temporalWindow.time_out }, [&args](const std::shared_ptr<Temporal_leaf>& leaf)
+			{
+				return aux_temporal_search(leaf, args);
+			});
+		if (args.t_stats != nullptr)
+			*args.t_stats += Spatial_leaf::temporal_t::last_stats();
 
 #ifdef DEBUG
 		std::cout << "\t> END   auxSpatialSearch." << std::endl;
@@ -406,8 +802,13 @@ public:
 	-Время входа в сегмент 
 	-Время выхода из сегмента
 	-Контейнер, в который записываются объекты, подходящие под поисковый запрос
+	-Проверка ребер с пространственным окном (по умолчанию ребро содержит окно)
+	-Проверка интервалов с временным окном (по умолчанию интервал внутри окна)
+	-Статистика запроса по уровням (заполняется при stats_policy = R_count_stats)
+	Для поиска по частичному перекрытию на обоих уровнях - mbr_test::intersects
 	*/
-	size_t search(int x1, int y1, int x2, int y2, double entranceTime, double exitTime, std::set<object_t>* resultArray)
+	size_t search(int x1, int y1, int x2, int y2, double entranceTime, double exitTime, std::set<object_t>* resultArray,
+		mbr_test spatialTest = mbr_test::covers, mbr_test temporalTest = mbr_test::inside, Search_stats* stats = nullptr) const
 	{
 #ifdef DEBUG
 		std::cout << "> BEGIN Search." << std::endl;
@@ -416,13 +817,24 @@ public:
 		resultArray->clear();
 		Line spatialWindow(std::min(x1, x2), std::min(y1, y2), std::max(x1, x2), std::max(y1, y2));
 		Interval temporalWindow(entranceTime, exitTime); /*временное окно*/
-		Search_args args(spatialWindow, temporalWindow, resultArray); /*пространственное окно*/
+		Search_args args(spatialWindow, temporalWindow, resultArray, temporalTest); /*пространственное окно*/
+		Search_stats queryStats{};
+		if (stats_policy::enabled && stats != nullptr)
+			args.t_stats = &queryStats.temporal;
 
 #ifdef DEBUG
 		std::cout << "\tsWindow : (" << spatialWindow.min[0] << ", " << spatialWindow.min[1] << "), (" << spatialWindow.max[0] << ", " << spatialWindow.max[1] << ")" << std::endl;
 #endif // DEBUG
 
-		this->spatial_level->search_objects({ spatialWindow.min, spatialWindow.max }, aux_spatial_search, (void*)&args);
+		this->spatial_level->search(spatialTest, { spatialWindow.min, spatialWindow.max }, [&args](const std::shared_ptr<Spatial_leaf>& id)
+			{
+				return aux_spatial_search(id, args);
+			});
+		if (stats_policy::enabled && stats != nullptr) /*счетчики пространственного поиска включают вложенные временные*/
+		{
+			queryStats.spatial = spatial_t::last_stats() - queryStats.temporal;
+			*stats = queryStats;
+		}
 
 #ifdef DEBUG
 		std::cout << "> END   Search." << std::endl;
@@ -431,6 +843,274 @@ public:
 		return resultArray->size();
 	}
 
+	/*
+	Пакетный поиск: результаты те же, что у search для каждого запроса
+	Аргументы:
+	-Запросы (пространственное и временное окно)
+	-Проверка ребер с пространственным окном
+	-Проверка интервалов с временным окном
+	-Статистика всего пакета по уровням (к ней прибавляются счетчики пакета при stats_policy = R_count_stats)
+	Пространственное дерево обходится один раз для всех запросов (в порядке кривой Гильберта),
+	временное дерево каждого найденного ребра - один раз для всех запросов, задевших ребро
+	Возвращает множества объектов в порядке запросов
+	*/
+	std::vector<std::set<object_t>> search_batch(const std::vector<Search_query>& queries,
+		mbr_test spatialTest = mbr_test::covers, mbr_test temporalTest = mbr_test::inside, Search_stats* stats = nullptr) const
+	{
+		std::vector<std::set<object_t>> results(queries.size());
+
+		std::vector<Line> spatialWindows{};
+		std::vector<typename spatial_t::mbr_t> windows{};
+		spatialWindows.reserve(queries.size());
+		windows.reserve(queries.size());
+		for (const Search_query& query : queries)
+		{
+			spatialWindows.emplace_back(std::min(query.x1, query.x2), std::min(query.y1, query.y2), std::max(query.x1, query.x2), std::max(query.y1, query.y2));
+			windows.push_back({ spatialWindows.back().min, spatialWindows.back().max });
+		}
+
+		std::vector<size_t> edgeQueries{}; /*запросы, окно которых пересекает отрезок ребра*/
+		std::vector<typename Spatial_leaf::temporal_t::mbr_t> temporalWindows{};
+		Search_stats batchStats{};
+		this->spatial_level->search_batch(spatialTest, windows, [&](const std::shared_ptr<Spatial_leaf>& edge, const std::vector<size_t>& hits)
+			{
+				edgeQueries.clear();
+				temporalWindows.clear();
+				for (size_t q : hits)
+				{
+					if (edge_intersect_window(*edge, spatialWindows[q]))
+					{
+						edgeQueries.push_back(q);
+						temporalWindows.push_back({ { queries[q].entrance_time }, { queries[q].exit_time } });
+					}
+				}
+				if (!edgeQueries.empty())
+				{
+					edge->get_temporal_tree()->search_batch(temporalTest, temporalWindows, [&](const std::shared_ptr<Temporal_leaf>& leaf, const std::vector<size_t>& local)
+						{
+							for (size_t l : local)
+							{
+								results[edgeQueries[l]].insert(leaf->get_id());
+							}
+							return true;
+						});
+					if constexpr (stats_policy::enabled)
+						batchStats.temporal += Spatial_leaf::temporal_t::last_stats();
+				}
+				return true;
+			});
+		if (stats_policy::enabled && stats != nullptr)
+		{
+			batchStats.spatial = spatial_t::last_stats() - batchStats.temporal;
+			*stats += batchStats;
+		}
+		return results;
+	}
+
+	/*
+	Параллельный пакетный поиск: запросы упорядочиваются по кривой Гильберта и делятся на пакеты,
+	пакеты выполняются search_batch в потоках пула pool
+	Результаты и статистика те же, что у search_batch
+	*/
+	std::vector<std::set<object_t>> search_parallel(const std::vector<Search_query>& queries, Thread_pool& pool,
+		mbr_test spatialTest = mbr_test::covers, mbr_test temporalTest = mbr_test::inside, Search_stats* stats = nullptr) const
+	{
+		std::vector<std::set<object_t>> results(queries.size());
+
+		std::vector<typename spatial_t::mbr_t> windows{};
+		windows.reserve(queries.size());
+		for (const Search_query& query : queries)
+		{
+			windows.push_back({ { std::min(query.x1, query.x2), std::min(query.y1, query.y2) }, { std::max(query.x1, query.x2), std::max(query.y1, query.y2) } });
+		}
+		std::vector<size_t> order{ hilbert_order<2>(windows.size(), [&windows](size_t i) -> const typename spatial_t::mbr_t& { return windows[i]; }) };
+
+		/*несколько пакетов на поток, чтобы свободные потоки могли перехватывать работу*/
+		size_t chunk{ std::max<size_t>(64, queries.size() / (pool.size() * 8) + 1) };
+		std::vector<Search_stats> chunkStats(stats != nullptr ? (order.size() + chunk - 1) / chunk : 0); /*счетчики потоков пула собираются по пакетам*/
+		pool.parallel_for(order.size(), chunk, [&](size_t begin, size_t end)
+			{
+				std::vector<Search_query> part{};
+				part.reserve(end - begin);
+				for (size_t i = begin; i < end; i++)
+				{
+					part.push_back(queries[order[i]]);
+				}
+				std::vector<std::set<object_t>> found{ this->search_batch(part, spatialTest, temporalTest, stats != nullptr ? &chunkStats[begin / chunk] : nullptr) };
+				for (size_t i = begin; i < end; i++)
+				{
+					results[order[i]] = std::move(found[i - begin]);
+				}
+			});
+		for (const Search_stats& part : chunkStats)
+		{
+			*stats += part;
+		}
+		return results;
+	}
+
+	/*
+	Курсор по перемещениям, подходящим под поисковый запрос (аргументы как у search)
+	Перемещения вычисляются по мере вызова next(), без сбора в контейнер
+	*/
+	Query_cursor query(int x1, int y1, int x2, int y2, double entranceTime, double exitTime,
+		mbr_test spatialTest = mbr_test::covers, mbr_test temporalTest = mbr_test::inside) const
+	{
+		Query_cursor cursor{};
+		cursor.s_window = Line(std::min(x1, x2), std::min(y1, y2), std::max(x1, x2), std::max(y1, y2));
+		cursor.t_window = Interval(entranceTime, exitTime);
+		cursor.t_test = temporalTest;
+		cursor.spatial.open(*this->spatial_level, spatialTest, { cursor.s_window.min, cursor.s_window.max });
+		return cursor;
+	}
+
+	/*
+	Поиск k ближайших к точке объектов, двигавшихся в промежуток времени
+	Аргументы:
+	-Точка
+	-Сколько объектов искать
+	-Время входа в сегмент
+	-Время выхода из сегмента
+	Ребра просматриваются в порядке возрастания расстояния от точки до отрезка ребра,
+	с каждого ребра берутся объекты, интервал движения которых пересекается с временным окном
+	Возвращает пары (объект, расстояние до ближайшего ребра, по которому он двигался) по возрастанию расстояния
+	*/
+	std::vector<std::pair<object_t, double>> nearest_objects(int x, int y, size_t k, double entranceTime, double exitTime) const
+	{
+		std::vector<std::pair<object_t, double>> result{};
+		if (k == 0)
+			return result;
+
+		std::set<object_t> found{};
+		/*ребра с известным расстоянием до отрезка, ближайшее - сверху*/
+		using candidate_t = std::pair<double, const Spatial_leaf*>;
+		std::priority_queue<candidate_t, std::vector<candidate_t>, std::greater<candidate_t>> candidates{};
+
+		/*объекты ребра; true - набрано k объектов*/
+		auto take = [&](const candidate_t& candidate)
+		{
+			candidate.second->get_temporal_tree()->search_intersecting({ entranceTime, exitTime }, [&](const std::shared_ptr<Temporal_leaf>& leaf)
+				{
+					if (found.insert(leaf->get_id()).second)
+						result.emplace_back(leaf->get_id(), candidate.first);
+					return found.size() < k;
+				});
+			return found.size() >= k;
+		};
+
+		bool done{ false };
+		/*MINDIST считается в double, как и edge_distance: в float большие целые координаты округляются и граница может превысить точное расстояние*/
+		this->spatial_level->template nearest<double>({ x, y }, std::numeric_limits<size_t>::max(), [&](const std::shared_ptr<Spatial_leaf>& edge, double mbrDistance)
+			{
+				/*отрезок не ближе своего mbr: ребра ближе mbr текущего ребра уже не обгонят оставшиеся*/
+				while (!candidates.empty() && candidates.top().first <= mbrDistance)
+				{
+					candidate_t candidate{ candidates.top() };
+					candidates.pop();
+					if (take(candidate))
+					{
+						done = true;
+						return false;
+					}
+				}
+				candidates.push({ edge_distance(*edge, x, y), edge.get() });
+				return true;
+			});
+		while (!done && !candidates.empty())
+		{
+			candidate_t candidate{ candidates.top() };
+			candidates.pop();
+			done = take(candidate);
+		}
+		return result;
+	}
+
+	/*
+	Образ дерева в памяти: пространственный уровень и все временные деревья без указателей
+	(Frozen_FNR_tree::load, fnrtree_frozen.hpp)
+	*/
+	std::vector<char> write_image() const
+	{
+		static_assert(std::is_trivially_copyable_v<object_t>, "объекты хранятся в образе побайтно");
+
+		std::vector<char> image(sizeof(Frozen_header));
+
+		/*сначала временные деревья и имена: их смещения нужны записям ребер*/
+		std::map<const Spatial_leaf*, Frozen_edge> edges{};
+		typename spatial_t::mbr_t everything{ { std::numeric_limits<int>::lowest(), std::numeric_limits<int>::lowest() },
+			{ std::numeric_limits<int>::max(), std::numeric_limits<int>::max() } };
+		this->spatial_level->search_intersecting(everything, [&image, &edges](const std::shared_ptr<Spatial_leaf>& leaf)
+			{
+				Frozen_edge edge{ leaf->get_line(), uint32_t(leaf->get_orientation()), uint32_t(leaf->get_name().size()), 0, 0 };
+				edge.temporal = leaf->get_temporal_tree()->write_image(image, [](const std::shared_ptr<Temporal_leaf>& move)
+					{
+						return Frozen_move{ move->get_id(), move->get_interval(), uint32_t(move->get_direction()) };
+					});
+				edge.name = image.size();
+				image.insert(image.end(), leaf->get_name().begin(), leaf->get_name().end());
+				edges[leaf.get()] = edge;
+				return true;
+			});
+
+		Frozen_header header{ frozen_fnr_magic, frozen_version, uint32_t(sizeof(object_t)), 0, 0, 0 };
+		header.spatial = this->spatial_level->write_image(image, [&edges](const std::shared_ptr<Spatial_leaf>& leaf)
+			{
+				return edges.at(leaf.get());
+			});
+		header.bytes = image.size();
+		std::memcpy(image.data(), &header, sizeof(Frozen_header));
+		return image;
+	}
+
+	/*
+	Запись образа дерева в файл, файл открывается Frozen_FNR_tree через отображение в память
+	Аргументы:
+	-Путь к файлу
+	Возвращает false, если файл не записан
+	*/
+	bool save_image(const char* path) const
+	{
+		return save_image_file(path, this->write_image());
+	}
+
+	/*
+	Форма дерева за один обход всех уровней (print выводит каждый узел, здесь - только сводка)
+	Аргументы:
+	-Сколько наибольших временных деревьев вернуть
+	*/
+	Tree_shape shape(size_t top = 10) const
+	{
+		Tree_shape report{ this->spatial_level->shape(), R_shape{}, 0, 0, {}, {} };
+
+		std::vector<std::pair<const Spatial_leaf*, size_t>> edges{};
+		constexpr int lowest{ std::numeric_limits<int>::lowest() }, highest{ std::numeric_limits<int>::max() };
+		this->spatial_level->search_intersecting({ { lowest, lowest }, { highest, highest } }, [&](const std::shared_ptr<Spatial_leaf>& edge)
+			{
+				R_shape temporal{ edge->get_temporal_tree()->shape() };
+				size_t bucket{ 0 };
+				for (size_t count = temporal.objects; count; count >>= 1)
+				{
+					bucket++;
+				}
+				if (report.histogram.size() <= bucket)
+					report.histogram.resize(bucket + 1);
+				report.histogram[bucket]++;
+				report.intervals += temporal.objects;
+				report.temporal += temporal;
+				edges.emplace_back(edge.get(), temporal.objects);
+				return true;
+			});
+		report.edges = edges.size();
+
+		top = std::min(top, edges.size());
+		std::partial_sort(edges.begin(), edges.begin() + top, edges.end(), [](const auto& a, const auto& b)
+			{
+				return a.second > b.second;
+			});
+		report.largest.assign(edges.begin(), edges.begin() + top);
+		return report;
+	}
+
 	size_t size() const
 	{
 		size_t self{ sizeof(FNR_tree) };
@@ -439,10 +1119,55 @@ public:
 			{
 				return leaf->size();
 			}) };
+		/*хеш отрезков: корзины и узлы со ссылкой на следующий*/
+		size_t index_size{ this->lines.bucket_count() * sizeof(void*) + this->lines.size() * (sizeof(typename decltype(this->lines)::value_type) + sizeof(void*)) };
+
+		/*хеш ребер по идентификатору*/
+		index_size += this->edges.bucket_count() * sizeof(void*) + this->edges.size() * (sizeof(typename decltype(this->edges)::value_type) + sizeof(void*));
 
-		return self + tree_size;
+		return self + tree_size + index_size;
 	}
 
 private:
 	spatial_level_t spatial_level;
+	/*ребра по нормализованному отрезку (при совпадении отрезков - первое вставленное ребро)*/
+	std::unordered_map<Line, std::shared_ptr<Spatial_leaf>, Line_hash, Line_equal> lines;
+	/*ребра по идентификатору (при повторе идентификатора - первое вставленное ребро); листами владеет пространственный уровень*/
+	std::unordered_map<long long, Spatial_leaf*> edges;
+
+	/*лист пространственного уровня для отрезка и его mbr*/
+	static typename spatial_t::entry_t make_spatial_entry(int x1, int y1, int x2, int y2, const std::string& name)
+	{
+		bool ori = !((x2 - x1) * (y2 - y1) >= 0); // 0 -> / , 1 -> \ .
+		Line tmpLine(std::min(x1, x2), std::min(y1, y2), std::max(x1, x2), std::max(y1, y2));
+
+		return { std::make_shared<Spatial_leaf>(tmpLine, ori, name), { tmpLine.min, tmpLine.max } };
+	}
+
+	/*ребро в хеш отрезков для insert_trip_segment*/
+	void index_line(const std::shared_ptr<Spatial_leaf>& edge)
+	{
+		this->lines.try_emplace(edge->get_line(), edge);
+	}
+
+	/*ребро в хеш по идентификатору для insert_trip_segment (отрицательные идентификаторы не индексируются)*/
+	void index_edge(long long edge_id, const std::shared_ptr<Spatial_leaf>& edge)
+	{
+		if (edge_id >= 0)
+			this->edges.try_emplace(edge_id, edge.get());
+	}
+
+	/*удаление перемещений по всем ребрам: каждое временное дерево сжимается один раз (см. Spatial_leaf::remove_intervals)*/
+	template<typename predicate_t>
+	size_t remove_trip_segments(mbr_test test, const Interval& window, const predicate_t& predicate)
+	{
+		constexpr int lowest{ std::numeric_limits<int>::lowest() }, highest{ std::numeric_limits<int>::max() };
+		size_t removed{};
+		this->spatial_level->search_intersecting({ { lowest, lowest }, { highest, highest } }, [&](const std::shared_ptr<Spatial_leaf>& edge)
+			{
+				removed += edge->remove_intervals(test, window, predicate);
+				return true;
+			});
+		return removed;
+	}
 };
\ No newline at end of file
@@ -0,0 +1,179 @@
+#pragma once
+
+#include "fnrtree.hpp"
+#include "rtree_frozen.hpp"
+#include "mapped_file.hpp"
+
+#include <string>
+#include <set>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+/*
+Замороженное FNR-дерево: поиск только для чтения по образу, записанному FNR_tree::save_image
+(или построенному в памяти load)
+Файл отображается в память и не разбирается: пространственное и временные деревья читаются прямо из отображения,
+страницы подгружаются по мере поиска и разделяются между процессами, открывшими тот же образ.
+Поисковые функции константные, их можно выполнять одновременно из нескольких потоков
+*/
+template <typename object_t>
+class Frozen_FNR_tree
+{
+public:
+	using tree_t = FNR_tree<object_t>;
+	using Frozen_edge = typename tree_t::Frozen_edge;
+	using Frozen_move = typename tree_t::Frozen_move;
+	using Search_query = typename tree_t::Search_query;
+	using spatial_t = Frozen_R_tree<Frozen_edge, int, 2, float>;
+	using temporal_t = Frozen_R_tree<Frozen_move, double, 1, float>;
+
+	Frozen_FNR_tree() = default;
+	~Frozen_FNR_tree() = default;
+
+	Frozen_FNR_tree(const Frozen_FNR_tree&) = delete;  /*конструкторы и операторы копирования и переноса удалены*/
+	Frozen_FNR_tree(Frozen_FNR_tree&&) = delete;
+	Frozen_FNR_tree operator=(const Frozen_FNR_tree&) = delete;
+	Frozen_FNR_tree operator=(Frozen_FNR_tree&&) = delete;
+
+	/*
+	Открытие образа
+	Аргументы:
+	-Путь к файлу, записанному FNR_tree::save_image
+	Возвращает false, если файл не открыт или не является образом FNR-дерева с таким типом объектов
+	*/
+	bool open(const char* path)
+	{
+		std::shared_ptr<Mapped_file> file{ std::make_shared<Mapped_file>() };
+		if (!file->open(path))
+		{
+			this->attach(nullptr, 0, nullptr);
+			return false;
+		}
+		const char* data{ file->data() };
+		size_t bytes{ file->size() };
+		return this->attach(data, bytes, std::move(file));
+	}
+
+	/*
+	Замораживание дерева в памяти: образ тот же, что в файле, исходное дерево можно менять или удалить
+	Аргументы:
+	-Дерево (с любой политикой статистики и любым временным индексом)
+	*/
+	template<typename stats_policy, typename temporal_policy>
+	bool load(const FNR_tree<object_t, stats_policy, temporal_policy>& tree)
+	{
+		std::shared_ptr<std::vector<char>> buffer{ std::make_shared<std::vector<char>>(tree.write_image()) };
+		const char* data{ buffer->data() };
+		size_t bytes{ buffer->size() };
+		return this->attach(data, bytes, std::move(buffer));
+	}
+
+	/*имя ребра*/
+	std::string get_name(const Frozen_edge& edge) const
+	{
+		return std::string(this->base + edge.name, edge.name_size);
+	}
+
+	/*временное дерево ребра (вид на образ)*/
+	temporal_t get_temporal_tree(const Frozen_edge& edge) const
+	{
+		return temporal_t(this->base + edge.temporal, this->bytes - size_t(edge.temporal));
+	}
+
+	/*
+	Поиск всех перемещений всех объектов на некотором отрезке за промежуток времени
+	Аргументы и результат - как у FNR_tree::search
+	*/
+	size_t search(int x1, int y1, int x2, int y2, double entranceTime, double exitTime, std::set<object_t>* resultArray,
+		mbr_test spatialTest = mbr_test::covers, mbr_test temporalTest = mbr_test::inside) const
+	{
+		resultArray->clear();
+		Line spatialWindow(std::min(x1, x2), std::min(y1, y2), std::max(x1, x2), std::max(y1, y2));
+
+		this->spatial.search(spatialTest, { spatialWindow.min, spatialWindow.max }, [&](const Frozen_edge& edge)
+			{
+				std::array<int, 4> p{ tree_t::edge_segment(edge.line, edge.orientation != 0) };
+				if (!tree_t::segment_intersect_rectangle(spatialWindow.min[0], spatialWindow.min[1], spatialWindow.max[0], spatialWindow.max[1], p[0], p[1], p[2], p[3]))
+					return true; /*отрезок ребра не проходит через окно: временное дерево не просматривается*/
+
+				this->get_temporal_tree(edge).search(temporalTest, { { entranceTime }, { exitTime } }, [resultArray](const Frozen_move& move)
+					{
+						resultArray->insert(move.object_id);
+						return true;
+					});
+				return true;
+			});
+
+		return resultArray->size();
+	}
+
+	/*пакетный поиск: результаты search для каждого запроса в порядке запросов*/
+	std::vector<std::set<object_t>> search_batch(const std::vector<Search_query>& queries,
+		mbr_test spatialTest = mbr_test::covers, mbr_test temporalTest = mbr_test::inside) const
+	{
+		std::vector<std::set<object_t>> results(queries.size());
+		for (size_t i = 0; i < queries.size(); i++)
+		{
+			const Search_query& q{ queries[i] };
+			this->search(q.x1, q.y1, q.x2, q.y2, q.entrance_time, q.exit_time, &results[i], spatialTest, temporalTest);
+		}
+		return results;
+	}
+
+	/*параллельный поиск: запросы делятся на пакеты между потоками пула pool, результаты те же, что у search_batch*/
+	std::vector<std::set<object_t>> search_parallel(const std::vector<Search_query>& queries, Thread_pool& pool,
+		mbr_test spatialTest = mbr_test::covers, mbr_test temporalTest = mbr_test::inside) const
+	{
+		std::vector<std::set<object_t>> results(queries.size());
+		size_t chunk{ std::max<size_t>(64, queries.size() / (pool.size() * 8) + 1) };
+		pool.parallel_for(queries.size(), chunk, [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					const Search_query& q{ queries[i] };
+					this->search(q.x1, q.y1, q.x2, q.y2, q.entrance_time, q.exit_time, &results[i], spatialTest, temporalTest);
+				}
+			});
+		return results;
+	}
+
+	/*размер образа в байтах*/
+	size_t size() const
+	{
+		return this->bytes;
+	}
+
+private:
+	/*владелец памяти образа: отображенный файл или буфер*/
+	std::shared_ptr<const void> storage{};
+	const char* base{ nullptr };
+	size_t bytes{ 0 };
+	spatial_t spatial{};
+
+	/*проверка заголовка и настройка пространственного дерева*/
+	bool attach(const char* image, size_t size, std::shared_ptr<const void> owner)
+	{
+		this->spatial = spatial_t{};
+		this->storage.reset();
+		this->base = nullptr;
+		this->bytes = 0;
+		if (image == nullptr || size < sizeof(typename tree_t::Frozen_header))
+			return false;
+
+		const typename tree_t::Frozen_header& header{ *reinterpret_cast<const typename tree_t::Frozen_header*>(image) };
+		if (header.magic != tree_t::frozen_fnr_magic || header.version != frozen_version || header.object_size != sizeof(object_t)
+			|| header.bytes > size || header.spatial >= header.bytes)
+			return false;
+
+		spatial_t tree(image + header.spatial, size_t(header.bytes - header.spatial));
+		if (!tree.valid())
+			return false;
+
+		this->spatial = tree;
+		this->storage = std::move(owner);
+		this->base = image;
+		this->bytes = size_t(header.bytes);
+		return true;
+	}
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/*
+Индекс точки на кривой Гильберта в num_dims-мерном пространстве
+Алгоритм Skilling (2004): координаты переводятся в "транспонированный" индекс,
+затем биты чередуются от старших к младшим.
+Аргументы:
+-Координаты точки, каждая в [0, 2^bits)
+-Число бит на координату (bits * num_dims <= 64)
+*/
+template<size_t num_dims>
+inline uint64_t hilbert_index(std::array<uint32_t, num_dims> x, uint32_t bits)
+{
+	static_assert(num_dims > 0, "пространство должно иметь хотя бы одно измерение");
+
+	uint32_t m{ uint32_t(1) << (bits - 1) };
+
+	/*обратное преобразование поворотов*/
+	for (uint32_t q = m; q > 1; q >>= 1)
+	{
+		uint32_t p{ q - 1 };
+		for (size_t i = 0; i < num_dims; i++)
+		{
+			if (x[i] & q)
+			{
+				x[0] ^= p;
+			}
+			else
+			{
+				uint32_t t{ (x[0] ^ x[i]) & p };
+				x[0] ^= t;
+				x[i] ^= t;
+			}
+		}
+	}
+
+	/*код Грея*/
+	for (size_t i = 1; i < num_dims; i++)
+	{
+		x[i] ^= x[i - 1];
+	}
+	uint32_t t{};
+	for (uint32_t q = m; q > 1; q >>= 1)
+	{
+		if (x[num_dims - 1] & q)
+			t ^= q - 1;
+	}
+	for (size_t i = 0; i < num_dims; i++)
+	{
+		x[i] ^= t;
+	}
+
+	/*чередование бит*/
+	uint64_t index{};
+	for (uint32_t b = bits; b-- > 0;)
+	{
+		for (size_t i = 0; i < num_dims; i++)
+		{
+			index = (index << 1) | ((x[i] >> b) & 1u);
+		}
+	}
+	return index;
+}
+
+/*число бит на координату, при котором индекс помещается в 64 бита*/
+template<size_t num_dims>
+constexpr uint32_t hilbert_bits()
+{
+	return 64 / num_dims > 31 ? 31 : uint32_t(64 / num_dims);
+}
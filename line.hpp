@@ -1,6 +1,9 @@
 #pragma once
 
 #include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
 
 class Line
 {
@@ -14,9 +17,32 @@ public:
 	std::array<int, 2> max;
 
 	/*функции*/
-	bool equals(const Line& other)
+	bool equals(const Line& other) const
 	{
 		return min[0] == other.min[0] && min[1] == other.min[1]
 			&& max[0] == other.max[0] && max[1] == other.max[1];
 	}
-};
\ No newline at end of file
+};
+
+/*хеш и сравнение отрезков для unordered_map (отрезок - по нормализованным концам min, max)*/
+struct Line_hash
+{
+	size_t operator()(const Line& line) const
+	{
+		uint64_t h{ 0x9E3779B97F4A7C15ull };
+		for (int v : { line.min[0], line.min[1], line.max[0], line.max[1] })
+		{
+			h ^= uint32_t(v);
+			h *= 0x100000001B3ull;
+			h ^= h >> 29;
+		}
+		return size_t(h);
+	}
+};
+struct Line_equal
+{
+	bool operator()(const Line& a, const Line& b) const
+	{
+		return a.equals(b);
+	}
+};
@@ -4,6 +4,8 @@
 #define new DEBUG_NEW
 
 #include "fnrtree.hpp"
+#include "fnrtree_frozen.hpp"
+#include "benchmark.hpp"
 
 #include <iostream>
 #include <iomanip>
@@ -12,6 +14,25 @@
 #include <string>
 #include <sstream>
 #include <chrono>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
+
+//#define FNR_STATS
+//#define FNR_BLOCKED_TEMPORAL
+
+#ifdef FNR_STATS
+using fnr_stats_t = R_count_stats; /*со счетчиками обходов: печатаются рядом со временем запросов*/
+#else
+using fnr_stats_t = R_no_stats;
+#endif // FNR_STATS
+#ifdef FNR_BLOCKED_TEMPORAL
+using fnr_temporal_t = FNR_blocked_temporal; /*временной индекс ребра из блоков, упорядоченных по времени входа*/
+#else
+using fnr_temporal_t = FNR_rtree_temporal;
+#endif // FNR_BLOCKED_TEMPORAL
+using fnr_tree_t = FNR_tree<long, fnr_stats_t, fnr_temporal_t>;
 
 void readNodes(const char* filename, std::map<long, std::pair<int, int> >* m) 
 {
@@ -31,7 +52,7 @@ void readNodes(const char* filename, std::map<long, std::pair<int, int> >* m)
 	}
 }
 
-void readEdges(const char* filename, std::map<long, std::pair<int, int> >* nodes, FNR_tree<long>* tree)
+void readEdges(const char* filename, std::map<long, std::pair<int, int> >* nodes, fnr_tree_t* tree)
 {
 	std::ifstream infile(filename);
 	if (!infile.is_open())
@@ -39,6 +60,7 @@ void readEdges(const char* filename, std::map<long, std::pair<int, int> >* nodes
 		std::cout << "not open file: " << filename << std::endl;
 	}
 	std::string line;
+	std::vector<fnr_tree_t::Network_edge> edges{};
 	while (std::getline(infile, line)) 
 	{
 		std::istringstream iss(line);
@@ -50,13 +72,23 @@ void readEdges(const char* filename, std::map<long, std::pair<int, int> >* nodes
 		std::pair<int, int> Acoord, Bcoord;
 		Acoord = nodes->find(A)->second;
 		Bcoord = nodes->find(B)->second;
-		tree->insert_line(Acoord.first, Acoord.second, Bcoord.first, Bcoord.second, name);
+		edges.emplace_back(id, Acoord.first, Acoord.second, Bcoord.first, Bcoord.second, name); /*перемещения можно вставлять и по id ребра*/
 	}
+	tree->load_network(edges); /*сеть известна целиком, строим пространственный уровень одним проходом*/
 }
 
-void readTrajectories(const char* filename, FNR_tree<long>* tree)
+/*перемещение объекта между двумя соседними точками траектории*/
+struct Trip_segment
+{
+	long id;
+	int x0, y0, x1, y1;
+	double t0, t1;
+};
+
+void readTrajectories(const char* filename, fnr_tree_t* tree, Thread_pool* pool)
 {
 	std::map<long, std::pair<double, std::pair<int, int>>> Objects; // id -> (time, (x,y) )
+	std::vector<Trip_segment> segments{};
 
 	std::ifstream infile(filename);
 	if (!infile.is_open())
@@ -87,16 +119,32 @@ void readTrajectories(const char* filename, FNR_tree<long>* tree)
 			double t0 = lastPos.first;
 			int x0 = lastPos.second.first;
 			int y0 = lastPos.second.second;
-			tree->insert_trip_segment(id, x0, y0, currX, currY, t0, time);
+			if (pool)
+				segments.push_back({ id, x0, y0, currX, currY, t0, time });
+			else
+				tree->insert_trip_segment(id, x0, y0, currX, currY, t0, time);
 			Objects[id] = std::make_pair(time, std::make_pair(currX, currY));
 
 		}
 	}
+
+	/*файл разбирается последовательно (точки объекта зависят от предыдущих), перемещения вставляются параллельно*/
+	if (pool)
+	{
+		pool->parallel_for(segments.size(), std::max<size_t>(segments.size() / (pool->size() * 8) + 1, 256), [&segments, tree](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; i++)
+				{
+					const Trip_segment& s{ segments[i] };
+					tree->insert_trip_segment(s.id, s.x0, s.y0, s.x1, s.y1, s.t0, s.t1);
+				}
+			});
+	}
 }
 
-void readQueries(const char* inFilename, const char* outFilename, FNR_tree<long>* tree)
+template<typename tree_t>
+void readQueries(const char* inFilename, const char* outFilename, const tree_t* tree, Thread_pool* pool)
 {
-	std::set<long>* resArray = new std::set<long>;
 	std::ifstream infile(inFilename);
 	if (!infile.is_open())
 	{
@@ -108,9 +156,7 @@ void readQueries(const char* inFilename, const char* outFilename, FNR_tree<long>
 		std::cout << "not open file: " << outFilename << std::endl;
 	}
 	std::string line;
-	int cont = 1;
-
-	std::chrono::microseconds duration(0);
+	std::vector<typename tree_t::Search_query> queries{};
 
 	while (std::getline(infile, line)) 
 	{
@@ -119,14 +165,25 @@ void readQueries(const char* inFilename, const char* outFilename, FNR_tree<long>
 		double t1, t2;
 		if (!(iss >> x1 >> y1 >> x2 >> y2 >> t1 >> t2)) break;
 
-		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
-		tree->search(x1, y1, x2, y2, t1, t2, resArray);
-		std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+		queries.emplace_back(x1, y1, x2, y2, t1, t2);
+	}
+
+	/*все запросы выполняются одним пакетом или делятся на пакеты между потоками*/
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	std::vector<std::set<long>> results{};
+	fnr_tree_t::Search_stats stats{};
+	if constexpr (std::is_same_v<tree_t, fnr_tree_t>)
+		results = pool ? tree->search_parallel(queries, *pool, mbr_test::covers, mbr_test::inside, &stats) : tree->search_batch(queries, mbr_test::covers, mbr_test::inside, &stats);
+	else
+		results = pool ? tree->search_parallel(queries, *pool) : tree->search_batch(queries);
+	std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
 
-		duration += std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+	std::chrono::microseconds duration{ std::chrono::duration_cast<std::chrono::microseconds>(end - start) };
 
-		outfile << "Test #" << cont++ << std::endl;
-		for (auto it = resArray->begin(); it != resArray->end(); ++it) 
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		outfile << "Test #" << i + 1 << std::endl;
+		for (auto it = results[i].begin(); it != results[i].end(); ++it) 
 		{
 			outfile << *it << " ";
 		}
@@ -136,8 +193,90 @@ void readQueries(const char* inFilename, const char* outFilename, FNR_tree<long>
 	std::cout << "   > Queries time  \t= " << std::right << std::setw(10);
 	std::cout << duration.count();
 	std::cout << " microseconds" << std::endl;
+#ifdef FNR_STATS
+	if constexpr (std::is_same_v<tree_t, fnr_tree_t>) /*счетчики всех запросов по уровням; у образа их нет*/
+	{
+		auto print = [&queries](const char* name, const R_stats& s)
+		{
+			double perQuery{ queries.empty() ? 0.0 : double(s.nodes_visited) / double(queries.size()) };
+			std::cout << "   > " << name << std::right << std::setw(10) << s.nodes_visited << " nodes ("
+				<< std::fixed << std::setprecision(1) << perQuery << std::defaultfloat << " per query), "
+				<< s.mbr_tests << " mbr tests, " << s.leaf_hits << " leaf hits" << std::endl;
+		};
+		print("Spatial stats \t= ", stats.spatial);
+		print("Temporal stats\t= ", stats.temporal);
+	}
+#endif // FNR_STATS
+	if (pool)
+	{
+		double seconds{ std::chrono::duration<double>(end - start).count() };
+		std::cout << "   > Query threads \t= " << std::right << std::setw(10) << pool->size() << std::endl;
+		std::cout << "   > Throughput    \t= " << std::right << std::setw(10)
+			<< size_t(seconds > 0 ? double(queries.size()) / seconds : 0.0) << " queries/s" << std::endl;
+	}
 	outfile.close();
-	delete resArray;
+}
+
+/*сводка формы дерева: уровни пространственного и временных деревьев, распределение перемещений по ребрам*/
+void printShape(const fnr_tree_t& tree)
+{
+	fnr_tree_t::Tree_shape shape{ tree.shape(5) };
+
+	auto print = [](const char* name, const R_shape& s)
+	{
+		std::cout << "   > " << name << std::right << std::setw(10) << s.nodes() << " nodes, height " << s.height
+			<< std::fixed << std::setprecision(2) << ", fill " << s.fill() << " (min " << s.min_fill() << ")"
+			<< ", dead space " << s.dead_space() << std::defaultfloat << ", overlap " << s.overlap()
+			<< ", underfull " << s.underfull() << std::endl;
+		for (size_t i = s.levels.size(); i-- > 0;)
+		{
+			std::cout << "     > level " << i << "	= " << std::right << std::setw(10) << s.levels[i].nodes << " nodes, fill "
+				<< std::fixed << std::setprecision(2) << s.fill(i) << std::defaultfloat << std::endl;
+		}
+	};
+	print("Spatial shape \t= ", shape.spatial);
+	print("Temporal shape\t= ", shape.temporal);
+
+	std::cout << "   > Moves per edge\t= ";
+	for (size_t i = 0; i < shape.histogram.size(); i++)
+	{
+		std::cout << (i ? " " : "") << "[" << (i ? size_t(1) << (i - 1) : 0) << "]:" << shape.histogram[i];
+	}
+	std::cout << std::endl;
+	for (const auto& edge : shape.largest)
+	{
+		std::cout << "     > " << edge.first->get_name() << "\t= " << std::right << std::setw(10) << edge.second << " moves" << std::endl;
+	}
+}
+
+/*ключи после позиционных аргументов: --threads N, --save-image файл; false - неизвестный ключ*/
+bool readOptions(int argc, char* argv[], int first, size_t& threads, const char*& imageFile)
+{
+	for (int i = first; i < argc; i += 2)
+	{
+		if (i + 1 >= argc)
+			return false;
+		std::string option{ argv[i] };
+		if (option == "--threads")
+			threads = std::max<size_t>(std::stoul(argv[i + 1]), 1);
+		else if (option == "--save-image")
+			imageFile = argv[i + 1];
+		else
+			return false;
+	}
+	return true;
+}
+
+void printUsage()
+{
+	std::cout << "Usage: ./fnr-tree.exe [nodesFile] [edgesFile] [trajectoriesFile] [queriesFile] [outFile] [--threads N] [--save-image imageFile]" << std::endl;
+	std::cout << "       ./fnr-tree.exe --image [imageFile] [queriesFile] [outFile] [--threads N]" << std::endl;
+	std::cout << "       ./fnr-tree.exe --bench-ingest [count]" << std::endl;
+	std::cout << "       ./fnr-tree.exe --bench-load [count]" << std::endl;
+	std::cout << "       ./fnr-tree.exe --bench-policy [count]" << std::endl;
+	std::cout << "       ./fnr-tree.exe --bench-temporal [count]" << std::endl;
+	std::cout << "       ./fnr-tree.exe --bench-freeze [count]" << std::endl;
+	std::cout << "       ./fnr-tree.exe --bench-remove [count]" << std::endl;
 }
 
 int main(int argc, char* argv[])
@@ -145,9 +284,80 @@ int main(int argc, char* argv[])
 	system("chcp 65001>nul");
 
 	{
-		if (argc != 6)
+		if (argc >= 2 && std::string(argv[1]) == "--bench-ingest")
+		{
+			size_t count{ argc >= 3 ? size_t(std::stoul(argv[2])) : 1000000u };
+			bench_ingest(count, std::max<size_t>(count / 10, 1));
+			return 0;
+		}
+		if (argc >= 2 && std::string(argv[1]) == "--bench-load")
+		{
+			size_t count{ argc >= 3 ? size_t(std::stoul(argv[2])) : 1000000u };
+			bench_bulk_load(count, 1000);
+			return 0;
+		}
+		if (argc >= 2 && std::string(argv[1]) == "--bench-policy")
+		{
+			size_t count{ argc >= 3 ? size_t(std::stoul(argv[2])) : 1000000u };
+			bench_insert_policy(count, 10000);
+			return 0;
+		}
+		if (argc >= 2 && std::string(argv[1]) == "--bench-temporal")
+		{
+			size_t count{ argc >= 3 ? size_t(std::stoul(argv[2])) : 1000000u };
+			bench_temporal_ingest(count, 10000);
+			return 0;
+		}
+
+		if (argc >= 2 && std::string(argv[1]) == "--bench-freeze")
 		{
-			std::cout << "Usage: ./fnr-tree.exe [nodesFile] [edgesFile] [trajectoriesFile] [queriesFile] [outFile]" << std::endl;
+			size_t count{ argc >= 3 ? size_t(std::stoul(argv[2])) : 1000000u };
+			bench_freeze(count, 10000);
+			return 0;
+		}
+		if (argc >= 2 && std::string(argv[1]) == "--bench-remove")
+		{
+			size_t count{ argc >= 3 ? size_t(std::stoul(argv[2])) : 200000u };
+			bench_remove(count);
+			return 0;
+		}
+
+		size_t threads{ 1 };
+		const char* imageFile{ nullptr };
+
+		if (argc >= 2 && std::string(argv[1]) == "--image") /*дерево из образа, без построения*/
+		{
+			if (argc < 5 || !readOptions(argc, argv, 5, threads, imageFile) || imageFile != nullptr)
+			{
+				printUsage();
+				return 1;
+			}
+
+			Frozen_FNR_tree<long> image;
+			std::unique_ptr<Thread_pool> pool{ threads > 1 ? std::make_unique<Thread_pool>(threads) : nullptr };
+			auto start = std::chrono::high_resolution_clock::now();
+			if (!image.open(argv[2]))
+			{
+				std::cout << "not open image: " << argv[2] << std::endl;
+				return 1;
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+
+			std::cout << "> FNR-Tree image indicators:" << std::endl;
+			std::cout << "   > IMAGE SIZE    \t= " << std::right << std::setw(10);
+			std::cout << image.size() << " Bytes" << std::endl;
+			std::cout << "   > Open time     \t= " << std::right << std::setw(10);
+			std::cout << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+			std::cout << " microseconds" << std::endl;
+
+			std::cout << "Start read queries" << std::endl;
+			readQueries(argv[3], argv[4], &image, pool.get());
+			return 0;
+		}
+
+		if (argc < 6 || !readOptions(argc, argv, 6, threads, imageFile))
+		{
+			printUsage();
 			return 1;
 		}
 
@@ -157,7 +367,8 @@ int main(int argc, char* argv[])
 		const char* queriesFile = argv[4];
 		const char* outFile = argv[5];
 
-		FNR_tree<long> kk;
+		fnr_tree_t kk;
+		std::unique_ptr<Thread_pool> pool{ threads > 1 ? std::make_unique<Thread_pool>(threads) : nullptr };
 
 		auto Nodes = new std::map<long, std::pair<int, int> >();
 		auto start = std::chrono::high_resolution_clock::now();
@@ -166,13 +377,9 @@ int main(int argc, char* argv[])
 		std::cout << "Start read edges" << std::endl;
 		readEdges(edgesFile, Nodes, &kk);
 
-		//kk.print();
-
 		auto start2 = std::chrono::high_resolution_clock::now();
 		std::cout << "Start read trajectories" << std::endl;
-		readTrajectories(trajectoriesFile, &kk);
-
-		kk.print();
+		readTrajectories(trajectoriesFile, &kk, pool.get());
 
 		auto end = std::chrono::high_resolution_clock::now();
 
@@ -186,9 +393,27 @@ int main(int argc, char* argv[])
 		std::cout << "   > Add traj. time \t= " << std::right << std::setw(10);
 		std::cout << std::chrono::duration_cast<std::chrono::microseconds>(end - start2).count();
 		std::cout << " microseconds" << std::endl;
+		printShape(kk);
+
+		if (imageFile != nullptr)
+		{
+			auto start3 = std::chrono::high_resolution_clock::now();
+			bool saved{ kk.save_image(imageFile) };
+			auto end3 = std::chrono::high_resolution_clock::now();
+			if (!saved)
+			{
+				std::cout << "not open file: " << imageFile << std::endl;
+			}
+			else
+			{
+				std::cout << "   > Save image time\t= " << std::right << std::setw(10);
+				std::cout << std::chrono::duration_cast<std::chrono::microseconds>(end3 - start3).count();
+				std::cout << " microseconds" << std::endl;
+			}
+		}
 
 		std::cout << "Start read queries" << std::endl;
-		readQueries(queriesFile, outFile, &kk);
+		readQueries(queriesFile, outFile, &kk, pool.get());
 
 		delete Nodes;
 	}
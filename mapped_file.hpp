@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <fstream>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif // WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif // NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+/*
+Файл, отображенный в память только для чтения (mmap / MapViewOfFile)
+Страницы подгружаются по мере обращения и разделяются между процессами, открывшими тот же файл
+*/
+class Mapped_file
+{
+public:
+	Mapped_file() = default;
+	~Mapped_file()
+	{
+		this->close();
+	}
+
+	Mapped_file(const Mapped_file&) = delete;  /*конструкторы и операторы копирования и переноса удалены*/
+	Mapped_file(Mapped_file&&) = delete;
+	Mapped_file& operator=(const Mapped_file&) = delete;
+	Mapped_file& operator=(Mapped_file&&) = delete;
+
+	/*отображение файла, false - файл не открыт или пуст*/
+	bool open(const char* path)
+	{
+		this->close();
+#ifdef _WIN32
+		this->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (this->file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER file_size{};
+		if (!GetFileSizeEx(this->file, &file_size) || file_size.QuadPart == 0)
+		{
+			this->close();
+			return false;
+		}
+		this->mapping = CreateFileMappingA(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (this->mapping == nullptr)
+		{
+			this->close();
+			return false;
+		}
+		this->view = static_cast<const char*>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+		if (this->view == nullptr)
+		{
+			this->close();
+			return false;
+		}
+		this->bytes = size_t(file_size.QuadPart);
+#else
+		this->file = ::open(path, O_RDONLY);
+		if (this->file < 0)
+			return false;
+		struct stat info {};
+		if (fstat(this->file, &info) != 0 || info.st_size == 0)
+		{
+			this->close();
+			return false;
+		}
+		void* address{ mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, this->file, 0) };
+		if (address == MAP_FAILED)
+		{
+			this->close();
+			return false;
+		}
+		this->view = static_cast<const char*>(address);
+		this->bytes = size_t(info.st_size);
+#endif // _WIN32
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (this->view != nullptr)
+			UnmapViewOfFile(this->view);
+		if (this->mapping != nullptr)
+			CloseHandle(this->mapping);
+		if (this->file != INVALID_HANDLE_VALUE)
+			CloseHandle(this->file);
+		this->mapping = nullptr;
+		this->file = INVALID_HANDLE_VALUE;
+#else
+		if (this->view != nullptr)
+			munmap(const_cast<char*>(this->view), this->bytes);
+		if (this->file >= 0)
+			::close(this->file);
+		this->file = -1;
+#endif // _WIN32
+		this->view = nullptr;
+		this->bytes = 0;
+	}
+
+	/*начало отображения (выровнено по странице)*/
+	const char* data() const
+	{
+		return this->view;
+	}
+	size_t size() const
+	{
+		return this->bytes;
+	}
+
+private:
+#ifdef _WIN32
+	HANDLE file{ INVALID_HANDLE_VALUE };
+	HANDLE mapping{ nullptr };
+#else
+	int file{ -1 };
+#endif // _WIN32
+	const char* view{ nullptr };
+	size_t bytes{ 0 };
+};
+
+/*запись образа в файл, false - файл не записан*/
+inline bool save_image_file(const char* path, const std::vector<char>& image)
+{
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+		return false;
+	out.write(image.data(), std::streamsize(image.size()));
+	return bool(out);
+}
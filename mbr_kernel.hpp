@@ -0,0 +1,356 @@
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/*
+SIMD-проверки mbr записей узла r-дерева
+Координаты записей хранятся по измерениям (ld[d][i], ru[d][i]),
+одна проверка узла выдает битовую маску подходящих записей.
+Специализации: int (пространственный уровень) и double (временной уровень),
+для остальных типов - скалярная версия.
+Для отключения SIMD: #define R_NO_SIMD
+*/
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif // _MSC_VER
+
+#if !defined(R_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#define R_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define R_TARGET_AVX2
+#else
+#define R_TARGET_AVX2 __attribute__((target("avx2")))
+#endif // _MSC_VER
+#endif // R_SIMD_X86
+
+/*вид проверки записи относительно окна запроса*/
+enum class mbr_test
+{
+	inside,    /*запись лежит внутри окна (during)*/
+	covers,    /*запись содержит окно (contains)*/
+	intersects /*запись пересекается с окном (overlaps)*/
+};
+
+/*
+проверка для внутренних узлов: в поддереве могут быть подходящие записи,
+только если mbr поддерева содержит окно (covers) или пересекается с ним (inside, intersects)
+*/
+constexpr mbr_test mbr_node_test(mbr_test test)
+{
+	return test == mbr_test::covers ? mbr_test::covers : mbr_test::intersects;
+}
+
+/*mbr записей узла по измерениям, число ячеек выровнено до 8 для векторной загрузки*/
+template<typename coord_type, size_t num_dims, size_t max_nodes>
+struct mbr_soa_t
+{
+	static constexpr size_t lanes{ (max_nodes + 7) / 8 * 8 };
+	using point_t = std::array<coord_type, num_dims>;
+
+	std::array<std::array<coord_type, lanes>, num_dims> ld{};
+	std::array<std::array<coord_type, lanes>, num_dims> ru{};
+
+	void set(size_t i, const point_t& p_ld, const point_t& p_ru)
+	{
+		for (size_t d = 0; d < num_dims; d++)
+		{
+			this->ld[d][i] = p_ld[d];
+			this->ru[d][i] = p_ru[d];
+		}
+	}
+	void get(size_t i, point_t& p_ld, point_t& p_ru) const
+	{
+		for (size_t d = 0; d < num_dims; d++)
+		{
+			p_ld[d] = this->ld[d][i];
+			p_ru[d] = this->ru[d][i];
+		}
+	}
+};
+
+/*индекс младшего установленного бита маски (маска не пуста)*/
+inline size_t mbr_first_bit(uint64_t mask)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+	unsigned long index{};
+	_BitScanForward64(&index, mask);
+	return size_t(index);
+#elif defined(_MSC_VER) /*Win32: 64-битного сканирования нет, младшая и старшая половины по отдельности*/
+	unsigned long index{};
+	if (_BitScanForward(&index, uint32_t(mask)))
+		return size_t(index);
+	_BitScanForward(&index, uint32_t(mask >> 32));
+	return size_t(index) + 32;
+#else
+	return size_t(__builtin_ctzll(mask));
+#endif // _MSC_VER
+}
+
+/*число установленных битов маски*/
+inline size_t mbr_popcount(uint64_t mask)
+{
+	return std::bitset<64>(mask).count();
+}
+
+/*вызов f(std::integral_constant<mbr_test, test>) с проверкой, известной при компиляции*/
+template<typename function_t>
+inline auto mbr_dispatch(mbr_test test, function_t&& f)
+{
+	switch (test)
+	{
+	case mbr_test::inside:
+		return f(std::integral_constant<mbr_test, mbr_test::inside>{});
+	case mbr_test::covers:
+		return f(std::integral_constant<mbr_test, mbr_test::covers>{});
+	default:
+		return f(std::integral_constant<mbr_test, mbr_test::intersects>{});
+	}
+}
+
+/*маска из count младших бит*/
+inline uint64_t mbr_count_mask(size_t count)
+{
+	return count >= 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+}
+
+#ifdef R_SIMD_X86
+/*проверка поддержки AVX2 процессором и ОС, выполняется один раз при запуске*/
+inline bool mbr_cpu_has_avx2()
+{
+#ifdef _MSC_VER
+	int info[4]{};
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	bool osxsave{ (info[2] & (1 << 27)) != 0 };
+	bool avx{ (info[2] & (1 << 28)) != 0 };
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif // _MSC_VER
+}
+
+inline const bool mbr_use_avx2{ mbr_cpu_has_avx2() };
+#endif // R_SIMD_X86
+
+/*скалярная проверка, используется для всех типов без специализации*/
+template<typename coord_type, size_t num_dims, size_t max_nodes>
+struct mbr_kernel
+{
+	using soa_t = mbr_soa_t<coord_type, num_dims, max_nodes>;
+	using point_t = typename soa_t::point_t;
+
+	static uint64_t mask(mbr_test test, const soa_t& boxes, size_t count, const point_t& ld, const point_t& ru)
+	{
+		return mbr_dispatch(test, [&](auto t) { return mask<decltype(t)::value>(boxes, count, ld, ru); });
+	}
+
+	template<mbr_test test>
+	static uint64_t mask(const soa_t& boxes, size_t count, const point_t& ld, const point_t& ru)
+	{
+		static_assert(max_nodes <= 64, "маска записей узла ограничена 64 битами");
+
+		return mask_rows<test>(boxes.ld[0].data(), boxes.ru[0].data(), soa_t::lanes, count, ld, ru);
+	}
+
+	/*
+	то же для записей, лежащих строками: ld измерения d - ld_rows[d * stride + i], ru - ru_rows[d * stride + i]
+	(векторные версии читают строку до ближайших 8 записей после count)
+	*/
+	template<mbr_test test>
+	static uint64_t mask_rows(const coord_type* ld_rows, const coord_type* ru_rows, size_t stride, size_t count, const point_t& ld, const point_t& ru)
+	{
+		uint64_t result{};
+		for (size_t i = 0; i < count; i++)
+		{
+			bool ok{ true };
+			for (size_t d = 0; d < num_dims && ok; d++)
+			{
+				const coord_type e_ld{ ld_rows[d * stride + i] };
+				const coord_type e_ru{ ru_rows[d * stride + i] };
+				if constexpr (test == mbr_test::inside)
+					ok = ld[d] <= e_ld && e_ru <= ru[d];
+				else if constexpr (test == mbr_test::covers)
+					ok = e_ld <= ld[d] && ru[d] <= e_ru;
+				else
+					ok = e_ld <= ru[d] && ld[d] <= e_ru;
+			}
+			if (ok)
+				result |= uint64_t(1) << i;
+		}
+		return result;
+	}
+};
+
+#ifdef R_SIMD_X86
+/*int: 8 записей за шаг на AVX2, 4 на SSE2*/
+template<size_t num_dims, size_t max_nodes>
+struct mbr_kernel<int, num_dims, max_nodes>
+{
+	using soa_t = mbr_soa_t<int, num_dims, max_nodes>;
+	using point_t = typename soa_t::point_t;
+	using coord_t = int;
+
+	static uint64_t mask(mbr_test test, const soa_t& boxes, size_t count, const point_t& ld, const point_t& ru)
+	{
+		return mbr_dispatch(test, [&](auto t) { return mask<decltype(t)::value>(boxes, count, ld, ru); });
+	}
+
+	template<mbr_test test>
+	static uint64_t mask(const soa_t& boxes, size_t count, const point_t& ld, const point_t& ru)
+	{
+		static_assert(max_nodes <= 64, "маска записей узла ограничена 64 битами");
+
+		return mask_rows<test>(boxes.ld[0].data(), boxes.ru[0].data(), soa_t::lanes, count, ld, ru);
+	}
+
+	template<mbr_test test>
+	static uint64_t mask_rows(const coord_t* ld_rows, const coord_t* ru_rows, size_t stride, size_t count, const point_t& ld, const point_t& ru)
+	{
+		return (mbr_use_avx2 ? mask_avx2<test>(ld_rows, ru_rows, stride, count, ld, ru) : mask_sse2<test>(ld_rows, ru_rows, stride, count, ld, ru)) & mbr_count_mask(count);
+	}
+
+	template<mbr_test test>
+	R_TARGET_AVX2 static uint64_t mask_avx2(const coord_t* ld_rows, const coord_t* ru_rows, size_t stride, size_t count, const point_t& ld, const point_t& ru)
+	{
+		uint64_t result{};
+		for (size_t i = 0; i < count; i += 8)
+		{
+			__m256i bad{ _mm256_setzero_si256() };
+			for (size_t d = 0; d < num_dims; d++)
+			{
+				__m256i e_ld{ _mm256_loadu_si256((const __m256i*)(ld_rows + d * stride + i)) };
+				__m256i e_ru{ _mm256_loadu_si256((const __m256i*)(ru_rows + d * stride + i)) };
+				__m256i q_ld{ _mm256_set1_epi32(ld[d]) };
+				__m256i q_ru{ _mm256_set1_epi32(ru[d]) };
+				if constexpr (test == mbr_test::inside)
+					bad = _mm256_or_si256(bad, _mm256_or_si256(_mm256_cmpgt_epi32(q_ld, e_ld), _mm256_cmpgt_epi32(e_ru, q_ru)));
+				else if constexpr (test == mbr_test::covers)
+					bad = _mm256_or_si256(bad, _mm256_or_si256(_mm256_cmpgt_epi32(e_ld, q_ld), _mm256_cmpgt_epi32(q_ru, e_ru)));
+				else
+					bad = _mm256_or_si256(bad, _mm256_or_si256(_mm256_cmpgt_epi32(e_ld, q_ru), _mm256_cmpgt_epi32(q_ld, e_ru)));
+			}
+			uint64_t bits{ uint64_t(~_mm256_movemask_ps(_mm256_castsi256_ps(bad)) & 0xFF) };
+			result |= bits << i;
+		}
+		return result;
+	}
+
+	template<mbr_test test>
+	static uint64_t mask_sse2(const coord_t* ld_rows, const coord_t* ru_rows, size_t stride, size_t count, const point_t& ld, const point_t& ru)
+	{
+		uint64_t result{};
+		for (size_t i = 0; i < count; i += 4)
+		{
+			__m128i bad{ _mm_setzero_si128() };
+			for (size_t d = 0; d < num_dims; d++)
+			{
+				__m128i e_ld{ _mm_loadu_si128((const __m128i*)(ld_rows + d * stride + i)) };
+				__m128i e_ru{ _mm_loadu_si128((const __m128i*)(ru_rows + d * stride + i)) };
+				__m128i q_ld{ _mm_set1_epi32(ld[d]) };
+				__m128i q_ru{ _mm_set1_epi32(ru[d]) };
+				if constexpr (test == mbr_test::inside)
+					bad = _mm_or_si128(bad, _mm_or_si128(_mm_cmpgt_epi32(q_ld, e_ld), _mm_cmpgt_epi32(e_ru, q_ru)));
+				else if constexpr (test == mbr_test::covers)
+					bad = _mm_or_si128(bad, _mm_or_si128(_mm_cmpgt_epi32(e_ld, q_ld), _mm_cmpgt_epi32(q_ru, e_ru)));
+				else
+					bad = _mm_or_si128(bad, _mm_or_si128(_mm_cmpgt_epi32(e_ld, q_ru), _mm_cmpgt_epi32(q_ld, e_ru)));
+			}
+			uint64_t bits{ uint64_t(~_mm_movemask_ps(_mm_castsi128_ps(bad)) & 0xF) };
+			result |= bits << i;
+		}
+		return result;
+	}
+};
+
+/*double: 4 записи за шаг на AVX2, 2 на SSE2*/
+template<size_t num_dims, size_t max_nodes>
+struct mbr_kernel<double, num_dims, max_nodes>
+{
+	using soa_t = mbr_soa_t<double, num_dims, max_nodes>;
+	using point_t = typename soa_t::point_t;
+	using coord_t = double;
+
+	static uint64_t mask(mbr_test test, const soa_t& boxes, size_t count, const point_t& ld, const point_t& ru)
+	{
+		return mbr_dispatch(test, [&](auto t) { return mask<decltype(t)::value>(boxes, count, ld, ru); });
+	}
+
+	template<mbr_test test>
+	static uint64_t mask(const soa_t& boxes, size_t count, const point_t& ld, const point_t& ru)
+	{
+		static_assert(max_nodes <= 64, "маска записей узла ограничена 64 битами");
+
+		return mask_rows<test>(boxes.ld[0].data(), boxes.ru[0].data(), soa_t::lanes, count, ld, ru);
+	}
+
+	template<mbr_test test>
+	static uint64_t mask_rows(const coord_t* ld_rows, const coord_t* ru_rows, size_t stride, size_t count, const point_t& ld, const point_t& ru)
+	{
+		return (mbr_use_avx2 ? mask_avx2<test>(ld_rows, ru_rows, stride, count, ld, ru) : mask_sse2<test>(ld_rows, ru_rows, stride, count, ld, ru)) & mbr_count_mask(count);
+	}
+
+	template<mbr_test test>
+	R_TARGET_AVX2 static uint64_t mask_avx2(const coord_t* ld_rows, const coord_t* ru_rows, size_t stride, size_t count, const point_t& ld, const point_t& ru)
+	{
+		uint64_t result{};
+		for (size_t i = 0; i < count; i += 4)
+		{
+			__m256d bad{ _mm256_setzero_pd() };
+			for (size_t d = 0; d < num_dims; d++)
+			{
+				__m256d e_ld{ _mm256_loadu_pd(ld_rows + d * stride + i) };
+				__m256d e_ru{ _mm256_loadu_pd(ru_rows + d * stride + i) };
+				__m256d q_ld{ _mm256_set1_pd(ld[d]) };
+				__m256d q_ru{ _mm256_set1_pd(ru[d]) };
+				if constexpr (test == mbr_test::inside)
+					bad = _mm256_or_pd(bad, _mm256_or_pd(_mm256_cmp_pd(q_ld, e_ld, _CMP_GT_OQ), _mm256_cmp_pd(e_ru, q_ru, _CMP_GT_OQ)));
+				else if constexpr (test == mbr_test::covers)
+					bad = _mm256_or_pd(bad, _mm256_or_pd(_mm256_cmp_pd(e_ld, q_ld, _CMP_GT_OQ), _mm256_cmp_pd(q_ru, e_ru, _CMP_GT_OQ)));
+				else
+					bad = _mm256_or_pd(bad, _mm256_or_pd(_mm256_cmp_pd(e_ld, q_ru, _CMP_GT_OQ), _mm256_cmp_pd(q_ld, e_ru, _CMP_GT_OQ)));
+			}
+			uint64_t bits{ uint64_t(~_mm256_movemask_pd(bad) & 0xF) };
+			result |= bits << i;
+		}
+		return result;
+	}
+
+	template<mbr_test test>
+	static uint64_t mask_sse2(const coord_t* ld_rows, const coord_t* ru_rows, size_t stride, size_t count, const point_t& ld, const point_t& ru)
+	{
+		uint64_t result{};
+		for (size_t i = 0; i < count; i += 2)
+		{
+			__m128d bad{ _mm_setzero_pd() };
+			for (size_t d = 0; d < num_dims; d++)
+			{
+				__m128d e_ld{ _mm_loadu_pd(ld_rows + d * stride + i) };
+				__m128d e_ru{ _mm_loadu_pd(ru_rows + d * stride + i) };
+				__m128d q_ld{ _mm_set1_pd(ld[d]) };
+				__m128d q_ru{ _mm_set1_pd(ru[d]) };
+				if constexpr (test == mbr_test::inside)
+					bad = _mm_or_pd(bad, _mm_or_pd(_mm_cmpgt_pd(q_ld, e_ld), _mm_cmpgt_pd(e_ru, q_ru)));
+				else if constexpr (test == mbr_test::covers)
+					bad = _mm_or_pd(bad, _mm_or_pd(_mm_cmpgt_pd(e_ld, q_ld), _mm_cmpgt_pd(q_ru, e_ru)));
+				else
+					bad = _mm_or_pd(bad, _mm_or_pd(_mm_cmpgt_pd(e_ld, q_ru), _mm_cmpgt_pd(q_ld, e_ru)));
+			}
+			uint64_t bits{ uint64_t(~_mm_movemask_pd(bad) & 0x3) };
+			result |= bits << i;
+		}
+		return result;
+	}
+};
+#endif // R_SIMD_X86
@@ -3,10 +3,25 @@
 #include <exception>
 #include <array>
 #include <vector>
-#include <variant>
 #include <limits>
 #include <iostream>
 #include <functional>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+#include <iterator>
+#include <cstddef>
+#include <queue>
+#include <cstring>
+#include <unordered_map>
+
+#include "mbr_kernel.hpp"
+#include "rtree_packing.hpp"
+#include "rtree_policy.hpp"
+#include "rtree_frozen.hpp"
+#include "rtree_stats.hpp"
 
 //#define RDEBUG
 
@@ -15,18 +30,24 @@ static int count_shared{ 0 };
 #endif // RDEBUG
 
 
-#define R_template   template<typename data_type, typename coord_type, size_t num_dims, typename float_type, size_t max_nodes, size_t min_nodes>
-#define R_class_area R_tree<data_type, coord_type, num_dims, float_type, max_nodes, min_nodes>
+#define R_template   template<typename data_type, typename coord_type, size_t num_dims, typename float_type, size_t max_nodes, size_t min_nodes, typename insert_policy, typename stats_policy>
+#define R_class_area R_tree<data_type, coord_type, num_dims, float_type, max_nodes, min_nodes, insert_policy, stats_policy>
 
 
-/*класс r-дерева*/
+/*
+класс r-дерева
+константные функции (поиск, курсоры, find, nearest) не меняют дерево и не используют общего изменяемого состояния:
+их можно вызывать одновременно из нескольких потоков, пока нет одновременных изменений дерева
+*/
 template<
 	typename data_type, 
 	typename coord_type, 
 	size_t num_dims, 
 	typename float_type,
 	size_t max_nodes = 8,
-	size_t min_nodes = max_nodes / 2>
+	size_t min_nodes = max_nodes / 2,
+	typename insert_policy = R_quadratic_policy,
+	typename stats_policy = R_no_stats>
 class R_tree
 {
 public:
@@ -42,6 +63,8 @@ public:
 		/*вторая точка*/
 		point_t ru;
 	};        
+	/*объект и его mbr для пакетной загрузки*/
+	using entry_t = std::pair<data_type, mbr_t>;
 
 	/*конструктор по умолчанию*/
 	R_tree();
@@ -56,18 +79,141 @@ public:
 	/*вставка нового значения в дерево с заданным mbr*/
 	void insert(const data_type& data, const mbr_t& mbr);
 
+	/*
+	пакетная загрузка: объекты из items (элементы - entry_t) вместе с уже лежащими в дереве
+	укладываются в полностью заполненные узлы, дерево строится снизу вверх;
+	порядок укладки задает политика packing_t (R_str_packing или R_hilbert_packing)
+	*/
+	template<typename packing_t = R_str_packing, typename range_t>
+	void bulk_load(const range_t& items);
+
+	/*
+	поиск объектов, mbr которых удовлетворяет проверке test с окном mbr, и применение к ним функции callback:
+	mbr_test::inside - объект внутри окна, mbr_test::covers - объект содержит окно, mbr_test::intersects - пересекается с окном
+	*/
+	size_t search(mbr_test test, const mbr_t& mbr, const callback_t& callback, void* context) const;
+
+	/*
+	то же с произвольным обработчиком: visitor(const data_type&) -> bool, false прекращает поиск;
+	обработчик и проверка подставляются в обход дерева, данные не копируются
+	*/
+	template<typename visitor_t>
+	size_t search(mbr_test test, const mbr_t& mbr, visitor_t&& visitor) const;
+
 	/*поиск объектов в диапазоне mbr и применение к ним функции callback*/
-	size_t search_in_range(const mbr_t& mbr, const callback_t& callback, void* context);
+	size_t search_in_range(const mbr_t& mbr, const callback_t& callback, void* context) const;
+	template<typename visitor_t>
+	size_t search_in_range(const mbr_t& mbr, visitor_t&& visitor) const;
 
 	/*поиск конкретных объектов с mbr и применение к ним функции callback*/
-	size_t search_objects(const mbr_t& mbr, const callback_t& callback, void* context);
+	size_t search_objects(const mbr_t& mbr, const callback_t& callback, void* context) const;
+	template<typename visitor_t>
+	size_t search_objects(const mbr_t& mbr, visitor_t&& visitor) const;
+
+	/*поиск объектов, пересекающихся с mbr, и применение к ним функции callback*/
+	size_t search_intersecting(const mbr_t& mbr, const callback_t& callback, void* context) const;
+	template<typename visitor_t>
+	size_t search_intersecting(const mbr_t& mbr, visitor_t&& visitor) const;
+
+	/*
+	ленивый курсор запроса: объекты выдаются по одному при каждом next(), обход ведется по явному стеку,
+	поэтому можно остановиться после первых N объектов или вести несколько запросов поочередно;
+	курсор действителен, пока дерево не изменяется
+	*/
+	class query_cursor;
+
+	/*курсор по объектам, удовлетворяющим проверке test с окном mbr*/
+	query_cursor query(mbr_test test, const mbr_t& mbr) const;
+
+	/*
+	k ближайших к точке объектов в порядке возрастания расстояния до их mbr (обход по очереди с приоритетом по MINDIST):
+	visitor(const data_type&, distance_t distance) -> bool, false прекращает поиск; возвращает число выданных объектов;
+	distance_t - тип, в котором считаются расстояния (double, если координаты не помещаются в точность float_type)
+	*/
+	template<typename distance_t = float_type, typename visitor_t>
+	size_t nearest(const point_t& point, size_t k, visitor_t&& visitor) const;
+
+	/*
+	пакетный поиск: запросы упорядочиваются по кривой Гильберта, каждый узел просматривается один раз
+	для всех запросов, окна которых его задевают;
+	visitor(const data_type&, const std::vector<size_t>& queries) -> bool вызывается один раз на объект
+	со списком индексов (в windows) всех запросов, которым он подходит; false прекращает поиск
+	*/
+	template<typename visitor_t>
+	void search_batch(mbr_test test, const std::vector<mbr_t>& windows, visitor_t&& visitor) const;
 
 	/*поиск нужного объекта по его mbr*/
 	const data_type& find(const mbr_t& mbr, bool& success) const;
 
+	/*число узлов, которые просматривает поиск с окном mbr (для сравнения политик вставки)*/
+	size_t count_visits(mbr_test test, const mbr_t& mbr) const;
+
 	/*удаление объекта*/
 	void remove(const mbr_t& mbr, const data_type& data);
 
+	/*
+	смена mbr объекта data, вставленного с old_mbr: если new_mbr лежит внутри mbr родителя листа, запись меняется
+	на месте и mbr предков только уточняются, иначе объект удаляется и вставляется заново;
+	false - объект не найден
+	*/
+	bool update(const data_type& data, const mbr_t& old_mbr, const mbr_t& new_mbr);
+
+	/*
+	пакетное удаление: объекты из items (элементы - entry_t, объект и mbr, по которому он был вставлен)
+	помечаются в листьях, затем дерево сжимается одним проходом снизу вверх: недозаполненные узлы убираются,
+	их записи (объекты и целые поддеревья) вставляются заново на свой уровень; возвращает число удаленных объектов
+	*/
+	template<typename range_t>
+	size_t remove_batch(const range_t& items);
+
+	/*
+	удаление всех объектов, для которых predicate(const data_type&) -> bool истинно, за один проход;
+	с окном просматриваются только объекты, удовлетворяющие проверке test с mbr; возвращает число удаленных объектов
+	*/
+	template<typename predicate_t>
+	size_t remove_if(predicate_t&& predicate);
+	template<typename predicate_t>
+	size_t remove_if(mbr_test test, const mbr_t& mbr, predicate_t&& predicate);
+
+	/*
+	запись образа дерева без указателей (см. rtree_frozen.hpp) в конец image, возвращает смещение образа в image;
+	convert(const data_type&) - объект для образа (тривиально копируемый), convert не должен менять image;
+	образ читается через Frozen_R_tree<тип результата convert, coord_type, num_dims, float_type>
+	*/
+	template<typename convert_t>
+	size_t write_image(std::vector<char>& image, convert_t&& convert) const;
+
+	/*запись образа в файл path, false - файл не записан*/
+	template<typename convert_t>
+	bool save_image(const char* path, convert_t&& convert) const;
+
+	/*замороженное дерево для объектов, которые возвращает convert*/
+	template<typename convert_t>
+	using frozen_t = Frozen_R_tree<std::decay_t<std::invoke_result_t<convert_t, const data_type&>>, coord_type, num_dims, float_type>;
+
+	/*
+	замороженная копия дерева в памяти (образ write_image): узлы подряд в порядке обхода в ширину,
+	записи без запаса до max_nodes, потомки адресуются смещением; дерево можно менять дальше, копия не изменится
+	*/
+	template<typename convert_t>
+	frozen_t<convert_t> freeze(convert_t&& convert) const;
+	/*то же для тривиально копируемых объектов*/
+	Frozen_R_tree<data_type, coord_type, num_dims, float_type> freeze() const;
+
+	/*
+	статистика обходов (см. rtree_stats.hpp, при stats_policy = R_no_stats - нули):
+	накопленные счетчики текущего потока, счетчики последней операции потока и их обнуление
+	*/
+	static R_stats stats();
+	static R_stats last_stats();
+	static void reset_stats();
+
+	/*
+	форма дерева за один обход (см. R_shape в rtree_stats.hpp): высота, узлы и заполненность по уровням,
+	пересечение mbr соседних записей и непокрытая площадь узлов
+	*/
+	R_shape shape() const;
+
 	/*дебаг: вывод дерева*/
 	void print(size_t level = 0, std::function<void(int, void*)> handler_data = {}) const;
 
@@ -75,22 +221,24 @@ public:
 
 private:
 	struct node;
-	/*shared_ptr указатель */
-	using node_ptr_t        = std::shared_ptr<node>;
+	/*указатель на узел из пула (не владеющий, узлами владеет пул дерева)*/
+	using node_ptr_t        = node*;
 	/*информация о потомке и его mbr (находится в внут. узле)*/
 	struct child_info_t     { node_ptr_t child; mbr_t mbr{}; };
 	/*информация об объекте и его mbr (находится в листе)*/
 	struct data_info_t      { data_type data; mbr_t mbr{}; };
 
-	/*массив информаций о потомках*/
-	using child_array_ptr_t = std::array<child_info_t, max_nodes>;
-	/*массив информаций об объектах (находится в листе)*/
-	using data_array_t      = std::array<data_info_t, max_nodes>;
-	/*enum-тип, хранит либо инф. о потомках, либо инф. об объектах*/
-	using data_node_t       = std::variant<child_array_ptr_t, data_array_t>;
+	/*массив указателей на потомков (находится во внутр. узле)*/
+	using child_array_ptr_t = std::array<node_ptr_t, max_nodes>;
+	/*массив объектов (находится в листе)*/
+	using data_array_t      = std::array<data_type, max_nodes>;
+	/*mbr записей узла, хранятся по измерениям: ld[d][i], ru[d][i]*/
+	using entries_mbr_t     = mbr_soa_t<coord_type, num_dims, max_nodes>;
+	/*векторная проверка mbr всех записей узла*/
+	using kernel_t          = mbr_kernel<coord_type, num_dims, max_nodes>;
+	/*тип площадей и периметров в политиках вставки: не уже coord_type (метки времени ~1e9 и целые выше 2^24 в float округляются)*/
+	using metric_t          = std::common_type_t<coord_type, float_type, double>;
 
-	/*корень дерева*/
-	node_ptr_t root;
 	/*дата, которая выводится при ошибке*/
 	data_type error_data{};
 
@@ -101,21 +249,20 @@ private:
 		mbr_t mbr{};
 		/*количество данных или указателей в массиве*/
 		size_t count_array{ 0 };
-		/*если не лист, храним ptr_array_t*/
-		data_node_t data{ child_array_ptr_t{} };
-		/*лист или нет?*/
+		/*mbr записей (потомков или объектов)*/
+		entries_mbr_t boxes{};
+		/*родитель узла (не владеющий указатель, nullptr у корня)*/
+		node* parent{ nullptr };
+		/*лист или нет? по флагу узел приводится к leaf_node или inner_node*/
 		bool leaf{ false };
 
 		/*конструктор, true - листочек*/
-		node(bool leaf)
+		node(bool leaf = false)
 			: leaf(leaf)
 		{
 #ifdef RDEBUG
 			count_shared++;
 #endif // RDEBUG
-
-			if (this->leaf) this->data = data_array_t{};
-			else this->data = child_array_ptr_t{};
 		}
 		~node()
 		{
@@ -124,119 +271,538 @@ private:
 			count_shared--;
 #endif // RDEBUG
 		}
+
+		/*доступ к записям узла*/
+		mbr_t get_mbr(size_t i) const
+		{
+			mbr_t m{};
+			this->boxes.get(i, m.ld, m.ru);
+			return m;
+		}
+		void set_mbr(size_t i, const mbr_t& m)
+		{
+			this->boxes.set(i, m.ld, m.ru);
+		}
+		node_ptr_t& child(size_t i)
+		{
+			return static_cast<inner_node*>(this)->children[i];
+		}
+		node_ptr_t child(size_t i) const
+		{
+			return static_cast<const inner_node*>(this)->children[i];
+		}
+		data_type& object(size_t i)
+		{
+			return static_cast<leaf_node*>(this)->objects[i];
+		}
+		const data_type& object(size_t i) const
+		{
+			return static_cast<const leaf_node*>(this)->objects[i];
+		}
+		child_info_t get_child(size_t i) const
+		{
+			return child_info_t{ this->child(i), this->get_mbr(i) };
+		}
+		data_info_t get_object(size_t i) const
+		{
+			return data_info_t{ this->object(i), this->get_mbr(i) };
+		}
+		template<typename info_t>
+		info_t get_entry(size_t i) const
+		{
+			if constexpr (std::is_same_v<info_t, child_info_t>) return this->get_child(i);
+			else return this->get_object(i);
+		}
+		void set_entry(size_t i, const child_info_t& info)
+		{
+			this->child(i) = info.child;
+			this->set_mbr(i, info.mbr);
+		}
+		void set_entry(size_t i, const data_info_t& info)
+		{
+			this->object(i) = info.data;
+			this->set_mbr(i, info.mbr);
+		}
+		/*перенос записи from на место to*/
+		void move_entry(size_t to, size_t from)
+		{
+			if (this->leaf) this->object(to) = std::move(this->object(from));
+			else this->child(to) = this->child(from);
+			this->set_mbr(to, this->get_mbr(from));
+		}
+		void clear_entry(size_t i)
+		{
+			if (this->leaf) this->object(i) = data_type{};
+			else this->child(i) = nullptr;
+			this->set_mbr(i, mbr_t{});
+		}
+		/*индекс потомка v в узле*/
+		size_t index_of(const node* v) const
+		{
+			const child_array_ptr_t& ref{ static_cast<const inner_node*>(this)->children };
+			return size_t(std::find(ref.begin(), ref.begin() + this->count_array, v) - ref.begin());
+		}
+		/*индекс объекта data в листе*/
+		size_t index_of(const data_type& data) const
+		{
+			const data_array_t& ref{ static_cast<const leaf_node*>(this)->objects };
+			return size_t(std::find(ref.begin(), ref.begin() + this->count_array, data) - ref.begin());
+		}
+		/*маска записей, удовлетворяющих проверке test с окном mbr*/
+		uint64_t match(mbr_test test, const mbr_t& mbr) const
+		{
+			return kernel_t::mask(test, this->boxes, this->count_array, mbr.ld, mbr.ru);
+		}
+		template<mbr_test test>
+		uint64_t match(const mbr_t& mbr) const
+		{
+			return kernel_t::template mask<test>(this->boxes, this->count_array, mbr.ld, mbr.ru);
+		}
+	};
+
+	/*
+	лист и внутренний узел: общая часть - node, массив записей у каждого свой,
+	поэтому узел не платит за больший из двух массивов
+	*/
+	struct leaf_node : node
+	{
+		/*объекты листа*/
+		data_array_t objects{};
+
+		leaf_node()
+			: node(true) {}
+	};
+	struct inner_node : node
+	{
+		/*указатели на потомков*/
+		child_array_ptr_t children{};
+
+		inner_node()
+			: node(false) {}
+	};
+
+	/*
+	блоки узлов одного типа: узлы лежат в непрерывных блоках (slab), размер блока растет вдвое до slab_max,
+	освобожденные узлы попадают в список свободных и переиспользуются,
+	вся память освобождается одним проходом по блокам вместе с деревом
+	*/
+	template<typename node_t>
+	class node_slabs
+	{
+	public:
+		node_slabs() = default;
+		~node_slabs() = default;
+
+		node_slabs(const node_slabs&) = delete;
+		node_slabs& operator=(const node_slabs&) = delete;
+
+		node_t* create()
+		{
+			node_t* v{ nullptr };
+			if (!this->free_nodes.empty())
+			{
+				v = this->free_nodes.back();
+				this->free_nodes.pop_back();
+			}
+			else
+			{
+				if (this->slabs.empty() || this->used == this->slab_size)
+				{
+					this->slab_size = this->slabs.empty() ? slab_min : std::min(this->slab_size * 2, slab_max);
+					this->slabs.push_back(std::make_unique<node_t[]>(this->slab_size));
+					this->total += this->slab_size;
+					this->used = 0;
+				}
+				v = &this->slabs.back()[this->used++];
+			}
+			*v = node_t{};
+			return v;
+		}
+
+		/*возврат узла, данные узла освобождаются сразу*/
+		void destroy(node_t* v)
+		{
+			*v = node_t{};
+			this->free_nodes.push_back(v);
+		}
+
+		/*память под выделенные блоки*/
+		size_t bytes() const
+		{
+			return this->total * sizeof(node_t);
+		}
+
+	private:
+		static constexpr size_t slab_min{ 1 };
+		static constexpr size_t slab_max{ 1024 };
+
+		std::vector<std::unique_ptr<node_t[]>> slabs{};
+		std::vector<node_t*> free_nodes{};
+		size_t slab_size{ 0 };
+		size_t used{ 0 };
+		size_t total{ 0 };
+	};
+
+	/*пул узлов: листья и внутренние узлы в отдельных блоках, тип выбирается по флагу leaf*/
+	class node_pool
+	{
+	public:
+		node_pool() = default;
+		~node_pool() = default;
+
+		node_pool(const node_pool&) = delete;
+		node_pool& operator=(const node_pool&) = delete;
+
+		/*выделение узла, true - листочек*/
+		node_ptr_t create(bool leaf)
+		{
+			if (leaf)
+				return this->leaves.create();
+			return this->inners.create();
+		}
+
+		/*возврат узла в пул*/
+		void destroy(node_ptr_t v)
+		{
+			if (v->leaf)
+				this->leaves.destroy(static_cast<leaf_node*>(v));
+			else
+				this->inners.destroy(static_cast<inner_node*>(v));
+		}
+
+		/*память под узлы, выделенная пулом*/
+		size_t bytes() const
+		{
+			return this->leaves.bytes() + this->inners.bytes();
+		}
+
+	private:
+		node_slabs<leaf_node> leaves{};
+		node_slabs<inner_node> inners{};
 	};
 
+	/*пул узлов, объявлен до корня: корень указывает внутрь пула*/
+	node_pool pool{};
+	/*корень дерева*/
+	node_ptr_t root;
+	/*число уровней дерева (у дерева из одного листа - 1)*/
+	size_t height{ 1 };
+
 	/*дебаг: печать дерева*/
 	void print(const node_ptr_t& to_print, size_t& level, std::function<void(int, void*)> handler_data) const;
 
+	/*форма поддерева v, level - уровень v (листья - 0)*/
+	void shape(const node* v, size_t level, R_shape& report) const;
+
 	/*поиск нужного объекта по его mbr в вершине v*/
 	const data_type& find(const node_ptr_t& v, const mbr_t& mbr, bool& success) const;
 
-	/*поиск объектов, в пределах mbr и применение к ним функции callback*/
-	size_t search(bool is_range, const mbr_t& mbr, const callback_t& callback, void* context);
+	/*поиск объектов, удовлетворяющих проверке test, в вершине v*/
+	template<mbr_test test, typename visitor_t>
+	bool search(const node* v, const mbr_t& mbr, size_t& count_found, visitor_t& visitor) const;
 
-	/*поиск объектов, в пределах mbr в вершине v*/
-	bool search(bool is_range, const node_ptr_t& v, const mbr_t& mbr, size_t& count_found, const callback_t& callback, void* context);
+	/*
+	пакетный поиск в вершине v глубины depth: queries[depth] - запросы, задевающие v,
+	queries[depth + 1] и masks[depth] - рабочая память уровня
+	*/
+	template<mbr_test test, typename visitor_t>
+	bool search_batch(const node* v, size_t depth, const std::vector<mbr_t>& windows,
+		std::vector<std::vector<size_t>>& queries, std::vector<std::vector<uint64_t>>& masks, visitor_t& visitor) const;
 
 	void size(size_t& total, const node_ptr_t& v, const size_callback_t& callback) const;
 
+	size_t count_visits(mbr_test test, const node* v, const mbr_t& mbr) const;
+
 	/*функции для работы с деревом*/
-	/*поиск листа, в который можно поместить новое значение*/
-	node_ptr_t choice_leaf(const mbr_t& mbr) const;
+	/*поиск узла уровня level (0 - листья), в который можно поместить запись с mbr*/
+	node* choose_node(const mbr_t& mbr, size_t level) const;
+
+	/*
+	вставка записи (объекта или поддерева) в узел уровня level,
+	reinserted - уровни, на которых уже была повторная вставка в рамках текущей вставки
+	*/
+	template<typename info_t>
+	void insert_entry(const info_t& info, size_t level, uint64_t& reinserted);
 
 	/*поиск листа, в котором находится объект с mbr*/
-	node_ptr_t find_object(node_ptr_t v, const mbr_t& mbr, const data_type& data) const;
+	node* find_object(node* v, const mbr_t& mbr, const data_type& data) const;
+	/*удаление записи index из листа l и сжатие пути от l к корню*/
+	void remove_entry(node* l, size_t index);
+
+	/*помеченные к удалению записи: лист и маска его записей*/
+	using tombstones_t = std::unordered_map<node*, uint64_t>;
+
+	/*пометка еще не помеченного объекта data с mbr в поддереве v, false - объект не найден*/
+	bool mark_object(node* v, const mbr_t& mbr, const data_type& data, tombstones_t& tombstones) const;
+
+	/*пометка объектов поддерева v, удовлетворяющих проверке test с mbr, для которых predicate истинно*/
+	template<mbr_test test, typename predicate_t>
+	void mark_if(node* v, const mbr_t& mbr, predicate_t& predicate, tombstones_t& tombstones) const;
 
-	/*деление листа на 2 по квадратичному алгоритму Гуттмана (1984)*/
-	node_ptr_t node_division(node_ptr_t l1, const data_type& data, const mbr_t& mbr);
+	/*
+	вырезание помеченных записей и сжатие дерева одним проходом снизу вверх по уровням:
+	каждый затронутый узел просматривается один раз, недозаполненный узел убирается из родителя,
+	его записи вставляются заново; возвращает число вырезанных объектов
+	*/
+	size_t condense(const tombstones_t& tombstones);
 
-	/*деление узла*/
-	node_ptr_t node_division(node_ptr_t l1, child_info_t new_child);
+	/*записи переполненного узла v вместе с новой записью extra*/
+	template<typename info_t>
+	std::array<info_t, max_nodes + 1> gather_entries(const node* v, const info_t& extra) const;
 
-	/*корректировка дерева*/
-	void correct_tree(node_ptr_t l1, node_ptr_t l2);                                 
+	/*заполнение узла v записями [first, last)*/
+	template<typename info_t>
+	void fill_node(node* v, const std::array<info_t, max_nodes + 1>& entries, size_t first, size_t last);
 
-	/*выбор пары из множества значений*/
-	std::pair<data_info_t, data_info_t> get_first_pair(std::vector<data_info_t>& q);
-	std::pair<child_info_t, child_info_t> get_first_pair(std::vector<child_info_t>& q);
+	/*деление переполненного узла l1 на 2 по политике insert_policy, возвращает новый узел*/
+	template<typename info_t>
+	node_ptr_t split_node(node* l1, const info_t& extra);
 
-	/*выбор следующего элемента по алгоритму Гуттмана (1984)*/
-	data_info_t get_next(node_ptr_t l1, node_ptr_t l2, std::vector<data_info_t>& q);
-	child_info_t get_next(node_ptr_t l1, node_ptr_t l2, std::vector<child_info_t>& q);
+	/*корректировка дерева: подъем от листа l1 к корню по ссылкам на родителей*/
+	void correct_tree(node* l1, node_ptr_t l2);
 
-	/*нахождение родителя элемента*/
-	node_ptr_t get_parent(node_ptr_t where, const node_ptr_t& what) const;
+	/*пересчет mbr узла по его записям*/
+	void recalc_mbr(node* v) const;
+
+	/*выставление ссылок на родителя у всех потомков узла v*/
+	void link_children(node* v) const;
 
 	/*получение данных из листочков*/
 	std::vector<data_info_t> get_all_data(node_ptr_t where);
 
+	/*возврат поддерева в пул*/
+	void free_subtree(node_ptr_t where);
+
+	/*упаковка упорядоченных записей в узлы одного уровня, возвращает записи о новых узлах*/
+	template<typename info_t>
+	std::vector<child_info_t> pack_level(const std::vector<info_t>& q, bool leaf);
+
+	/*счетчики статистики: при выключенной статистике вызовы пустые*/
+	static void count_visit(size_t entries);
+	static void count_hits(uint64_t hits);
+	static void count_split();
+	static void count_reinserts(size_t entries);
+	static void count_parent_step();
+
 	/*функции для работы с mbr*/
 	mbr_t sum_mbr(const mbr_t& m1, const mbr_t& m2) const;              /*новый mbr из 2-х*/
-	coord_type calc_square(const mbr_t& m) const;                       /*вычисление площади */
-	coord_type diff_square_mbr(const mbr_t& m1, const mbr_t& m2) const; /*разница в площадях двух mbr*/
 	bool include_mbr(const mbr_t& where_find, const mbr_t& what_find) const;/*включает ли один mbr другой*/
+	bool intersect_mbr(const mbr_t& m1, const mbr_t& m2) const;         /*пересекаются ли два mbr*/
+	bool test_mbr(mbr_test test, const mbr_t& entry, const mbr_t& window) const; /*проверка test записи entry с окном window*/
+	template<typename distance_t = float_type>
+	distance_t min_dist(const point_t& point, const mbr_t& m) const;    /*квадрат расстояния от точки до mbr (MINDIST)*/
 };
 
 R_template
-inline R_class_area::R_tree()
-	:root(std::make_shared<node>(true))
+class R_class_area::query_cursor
 {
-}
+public:
+	class iterator
+	{
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = data_type;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const data_type*;
+		using reference = const data_type&;
+
+		iterator() = default;
+		explicit iterator(query_cursor* cursor)
+			: cursor(cursor) {}
+
+		reference operator*() const { return this->cursor->data(); }
+		pointer operator->() const { return &this->cursor->data(); }
+		iterator& operator++()
+		{
+			if (!this->cursor->next())
+				this->cursor = nullptr;
+			return *this;
+		}
+		bool operator==(const iterator& other) const { return this->cursor == other.cursor; }
+		bool operator!=(const iterator& other) const { return this->cursor != other.cursor; }
 
-R_template
-inline typename R_class_area::node_ptr_t R_class_area::choice_leaf(const mbr_t& mbr) const
-{
-	node_ptr_t tmp{ this->root };
-	while (!tmp->leaf)
+	private:
+		query_cursor* cursor{ nullptr };
+	};
+
+	query_cursor() = default;
+
+	/*начать новый запрос к дереву tree, память стека переиспользуется*/
+	void open(const R_tree& tree, mbr_test test, const mbr_t& mbr)
+	{
+		this->stack.clear();
+		this->leaf = nullptr;
+		this->started = false;
+		this->test = test;
+		this->mbr = mbr;
+		const node* root{ tree.root };
+		if (root->count_array && tree.test_mbr(mbr_node_test(test), root->mbr, mbr))
+		{
+			this->stack.reserve(tree.height);
+			this->push(root);
+		}
+	}
+
+	/*переход к следующему объекту, false - объектов больше нет*/
+	bool next()
 	{
-		const child_array_ptr_t& ptrs{ std::get<child_array_ptr_t>(tmp->data) };
-		coord_type min_diff{ std::numeric_limits<coord_type>::max() };
-		coord_type cur_diff{};
-		size_t need_child{};
-		for (size_t i = 0; i < tmp->count_array; i++)
+		this->started = true;
+		while (!this->stack.empty())
 		{
-			cur_diff = this->diff_square_mbr(this->sum_mbr(ptrs[i].mbr, mbr), mbr);
-			if (cur_diff <= min_diff)
+			frame& top{ this->stack.back() };
+			if (!top.hits)
+			{
+				this->stack.pop_back();
+				continue;
+			}
+			size_t i{ mbr_first_bit(top.hits) };
+			top.hits &= top.hits - 1;
+			if (top.v->leaf)
 			{
-				min_diff = cur_diff;
-				need_child = i;
+				this->leaf = top.v;
+				this->index = i;
+				return true;
 			}
+			this->push(top.v->child(i));
 		}
-		tmp = ptrs[need_child].child;
+		this->leaf = nullptr;
+		return false;
 	}
-	return tmp;
+
+	/*текущий объект и его mbr (после успешного next())*/
+	const data_type& data() const
+	{
+		return this->leaf->object(this->index);
+	}
+	mbr_t get_mbr() const
+	{
+		return this->leaf->get_mbr(this->index);
+	}
+
+	/*обход курсора в цикле for: начинает с текущего положения*/
+	iterator begin()
+	{
+		if (!this->started)
+			this->next();
+		return this->leaf ? iterator(this) : iterator();
+	}
+	iterator end()
+	{
+		return iterator();
+	}
+
+private:
+	/*узел на стеке обхода и еще не просмотренные подходящие записи*/
+	struct frame
+	{
+		const node* v;
+		uint64_t hits;
+	};
+
+	void push(const node* v)
+	{
+		R_tree::count_visit(v->count_array);
+		this->stack.push_back(frame{ v, v->match(v->leaf ? this->test : mbr_node_test(this->test), this->mbr) });
+		if (v->leaf)
+			R_tree::count_hits(this->stack.back().hits);
+	}
+
+	std::vector<frame> stack{};
+	const node* leaf{ nullptr };
+	size_t index{ 0 };
+	bool started{ false };
+	mbr_test test{ mbr_test::intersects };
+	mbr_t mbr{};
+};
+
+R_template
+inline R_class_area::R_tree()
+	:root(this->pool.create(true))
+{
 }
 
 R_template
-inline typename R_class_area::mbr_t R_class_area::sum_mbr(const mbr_t& m1, const mbr_t& m2) const
+inline R_stats R_class_area::stats()
 {
-	point_t ld{}, ru{};
-	for (size_t i = 0; i < num_dims; i++)
+	return stats_policy::counters();
+}
+
+R_template
+inline R_stats R_class_area::last_stats()
+{
+	return stats_policy::last();
+}
+
+R_template
+inline void R_class_area::reset_stats()
+{
+	stats_policy::reset();
+}
+
+R_template
+inline void R_class_area::count_visit(size_t entries)
+{
+	if constexpr (stats_policy::enabled)
 	{
-		ld[i] = std::min(m1.ld[i], m2.ld[i]); /*левая нижняя точка*/
-		ru[i] = std::max(m1.ru[i], m2.ru[i]); /*правая верхняя точка*/
+		stats_policy::counters().nodes_visited++;
+		stats_policy::counters().mbr_tests += entries;
 	}
-	return mbr_t{ ld,ru };
 }
 
 R_template
-inline coord_type R_class_area::diff_square_mbr(const mbr_t& m1, const mbr_t& m2) const
+inline void R_class_area::count_hits(uint64_t hits)
 {
-	return std::abs(this->calc_square(m1) - this->calc_square(m2));
+	if constexpr (stats_policy::enabled)
+		stats_policy::counters().leaf_hits += uint64_t(mbr_popcount(hits));
 }
 
 R_template
-inline coord_type R_class_area::calc_square(const mbr_t& m) const
+inline void R_class_area::count_split()
 {
-	coord_type square{ std::abs(m.ld[0] - m.ru[0]) };
-	if (num_dims > 1)
+	if constexpr (stats_policy::enabled)
+		stats_policy::counters().splits++;
+}
+
+R_template
+inline void R_class_area::count_reinserts(size_t entries)
+{
+	if constexpr (stats_policy::enabled)
+		stats_policy::counters().reinserts += entries;
+}
+
+R_template
+inline void R_class_area::count_parent_step()
+{
+	if constexpr (stats_policy::enabled)
+		stats_policy::counters().parent_steps++;
+}
+
+R_template
+inline typename R_class_area::node* R_class_area::choose_node(const mbr_t& mbr, size_t level) const
+{
+	node* tmp{ this->root };
+	size_t tmp_level{ this->height - 1 };
+	while (tmp_level > level)
 	{
-		for (size_t i = 1; i < num_dims; i++)
-		{
-			square *= std::abs(m.ld[i] - m.ru[i]);
-		}
+		count_visit(tmp->count_array);
+		size_t need_child{ insert_policy::template choose_subtree<metric_t>(
+			[tmp](size_t i) { return tmp->get_mbr(i); }, tmp->count_array, mbr, tmp_level == 1) };
+		tmp = tmp->child(need_child);
+		tmp_level--;
+	}
+	return tmp;
+}
+
+R_template
+inline typename R_class_area::mbr_t R_class_area::sum_mbr(const mbr_t& m1, const mbr_t& m2) const
+{
+	point_t ld{}, ru{};
+	for (size_t i = 0; i < num_dims; i++)
+	{
+		ld[i] = std::min(m1.ld[i], m2.ld[i]); /*левая нижняя точка*/
+		ru[i] = std::max(m1.ru[i], m2.ru[i]); /*правая верхняя точка*/
 	}
-	return std::abs(square);
+	return mbr_t{ ld,ru };
 }
 
 R_template
@@ -251,298 +817,149 @@ inline bool R_class_area::include_mbr(const mbr_t& where_find, const mbr_t& what
 }
 
 R_template
-inline void R_class_area::insert(const data_type& data, const mbr_t& mbr)
+inline bool R_class_area::intersect_mbr(const mbr_t& m1, const mbr_t& m2) const
 {
-	node_ptr_t l{ choice_leaf(mbr) };
-	node_ptr_t new_node{ nullptr };
-
-	if (l->count_array < max_nodes) /*если значение помещается в текущий узел*/
-	{
-		data_array_t& arr{ std::get<data_array_t>(l->data) };
-		arr[l->count_array].data = data; /*добавляем значение в узел*/
-		arr[l->count_array].mbr = mbr;
-		l->count_array++;
-		l->mbr = l->count_array == 1 ? mbr : this->sum_mbr(l->mbr, mbr); /*если в узле 1 вершина, ставим mbr новых данных, иначе находим сумму*/
-	}
-	else /*делим узел на два*/
+	for (size_t i = 0; i < num_dims; i++)
 	{
-		new_node = this->node_division(l, data, mbr);
+		if (m1.ru[i] < m2.ld[i] || m2.ru[i] < m1.ld[i])
+			return false;
 	}
-	this->correct_tree(l, new_node); /*корректируем дерево*/
+	return true;
 }
 
 R_template
-inline typename R_class_area::node_ptr_t R_class_area::node_division(node_ptr_t l1, const data_type& data, const mbr_t& mbr)
+inline bool R_class_area::test_mbr(mbr_test test, const mbr_t& entry, const mbr_t& window) const
 {
-	/*подготовка*/
-	node_ptr_t l2(std::make_shared<node>(true)); /*выделение памяти на лист*/
-	data_array_t& l1_data{ std::get<data_array_t>(l1->data) };
-	data_array_t& l2_data{ std::get<data_array_t>(l2->data) };
-	std::vector<data_info_t> q{ l1_data.begin(), l1_data.end() }; /*заполнение o*/
-	q.push_back(data_info_t{ data, mbr });
-	for (size_t i = 0; i < max_nodes; i++) /*очистка l1*/
+	switch (test)
 	{
-		l1_data[i].data = data_type{};
-		l1_data[i].mbr = mbr_t{};
+	case mbr_test::inside:
+		return this->include_mbr(window, entry);
+	case mbr_test::covers:
+		return this->include_mbr(entry, window);
+	default:
+		return this->intersect_mbr(entry, window);
 	}
-	l1->count_array = 0;
-	l1->mbr = {};
-
-	/*первые значения*/
-	std::pair<data_info_t, data_info_t> obj = this->get_first_pair(q);
-	l1_data[l1->count_array] = obj.first;
-	l1->count_array++;
-	l1->mbr = obj.first.mbr;  /*-_- изменяем mbr*/
-	l2_data[l2->count_array] = obj.second;
-	l2->count_array++;
-	l2->mbr = obj.second.mbr; /*-_- изменяем mbr*/
+}
 
-	/*остальные значения*/
-	while (true)
+R_template
+template<typename distance_t>
+inline distance_t R_class_area::min_dist(const point_t& point, const mbr_t& m) const
+{
+	distance_t dist{};
+	for (size_t i = 0; i < num_dims; i++)
 	{
-		size_t n{ q.size() };
-		size_t n1{ l1->count_array };
-		size_t n2{ l2->count_array };
-
-		if (n == 0)
-		{
-			return l2;
-		}
-		else if (int(min_nodes) - int(n1) >= int(n))
-		{
-			for (size_t i = 0; i < q.size(); i++)
-			{
-				l1_data[l1->count_array] = q[i];
-				l1->count_array++;
-				l1->mbr = this->sum_mbr(l1->mbr, q[i].mbr); /*изменяем mbr всего листа*/
-			}
-			return l2;
-		}
-		else if (int(min_nodes) - int(n2) >= int(n))
-		{
-			for (size_t i = 0; i < q.size(); i++)
-			{
-				l2_data[l2->count_array] = q[i];
-				l2->count_array++;
-				l2->mbr = this->sum_mbr(l2->mbr, q[i].mbr); /*изменяем mbr всего листа*/
-			}
-			return l2;
-		}
-
-		data_info_t o_next{ this->get_next(l1,l2,q) };
-		coord_type d1{ this->diff_square_mbr(this->sum_mbr(l1->mbr, o_next.mbr), l1->mbr) };
-		coord_type d2{ this->diff_square_mbr(this->sum_mbr(l2->mbr, o_next.mbr), l2->mbr) };
-
-		if (d1 < d2 || (d1 == d2 && n1 < n2))
-		{
-			l1_data[l1->count_array] = o_next;
-			l1->count_array++;
-			l1->mbr = this->sum_mbr(l1->mbr, o_next.mbr); /*изменяем mbr всего листа*/
-		}
-		else
-		{
-			l2_data[l2->count_array] = o_next;
-			l2->count_array++;
-			l2->mbr = this->sum_mbr(l2->mbr, o_next.mbr); /*изменяем mbr всего листа*/
-		}
+		distance_t delta{};
+		if (point[i] < m.ld[i])
+			delta = distance_t(m.ld[i]) - distance_t(point[i]);
+		else if (m.ru[i] < point[i])
+			delta = distance_t(point[i]) - distance_t(m.ru[i]);
+		dist += delta * delta;
 	}
+	return dist;
 }
 
-
 R_template
-inline typename R_class_area::node_ptr_t R_class_area::node_division(node_ptr_t l1, child_info_t new_child)
+inline void R_class_area::insert(const data_type& data, const mbr_t& mbr)
 {
+	typename stats_policy::scope scope{};
+	uint64_t reinserted{};
+	this->insert_entry(data_info_t{ data, mbr }, 0, reinserted);
+}
 
-	/*подготовка*/
-	node_ptr_t l2(std::make_shared<node>(false)); /*выделение памяти на узел*/
-	child_array_ptr_t& l1_data{ std::get<child_array_ptr_t>(l1->data) };
-	child_array_ptr_t& l2_data{ std::get<child_array_ptr_t>(l2->data) };
-	std::vector<child_info_t> q{ l1_data.begin(), l1_data.end() }; /*заполнение o*/
-	q.push_back(new_child);
-	for (size_t i = 0; i < max_nodes; i++) /*очистка l1*/
-	{
-		l1_data[i].child = nullptr;
-		l1_data[i].mbr = mbr_t{};
-	}
-	l1->count_array = 0;
-	l1->mbr = {};
-
-	/*первые значения*/
-	std::pair<child_info_t, child_info_t> obj = this->get_first_pair(q);
-	l1_data[l1->count_array] = obj.first;
-	l1->count_array++;
-	l1->mbr = obj.first.mbr;  /*-_- изменяем mbr*/
-	l2_data[l2->count_array] = obj.second;
-	l2->count_array++;
-	l2->mbr = obj.second.mbr; /*-_- изменяем mbr*/
+R_template
+template<typename info_t>
+inline void R_class_area::insert_entry(const info_t& info, size_t level, uint64_t& reinserted)
+{
+	node* l{ this->choose_node(info.mbr, level) };
 
-	/*остальные значения*/
-	while (true)
+	if (l->count_array < max_nodes) /*если значение помещается в текущий узел*/
 	{
-		size_t n{ q.size() };
-		size_t n1{ l1->count_array };
-		size_t n2{ l2->count_array };
-
-		if (n == 0)
-		{
-			return l2;
-		}
-		else if (int(min_nodes) - int(n1) >= int(n))
-		{
-			for (size_t i = 0; i < q.size(); i++)
-			{
-				l1_data[l1->count_array] = q[i];
-				l1->count_array++;
-				l1->mbr = this->sum_mbr(l1->mbr, q[i].mbr); /*изменяем mbr всего листа*/
-			}
-			return l2;
-		}
-		else if (int(min_nodes) - int(n2) >= int(n))
-		{
-			for (size_t i = 0; i < q.size(); i++)
-			{
-				l2_data[l2->count_array] = q[i];
-				l2->count_array++;
-				l2->mbr = this->sum_mbr(l2->mbr, q[i].mbr); /*изменяем mbr всего листа*/
-			}
-			return l2;
-		}
-
-		child_info_t o_next{ this->get_next(l1,l2,q) };
-		coord_type d1{ this->diff_square_mbr(this->sum_mbr(l1->mbr, o_next.mbr), l1->mbr) };
-		coord_type d2{ this->diff_square_mbr(this->sum_mbr(l2->mbr, o_next.mbr), l2->mbr) };
-
-		if (d1 < d2 || (d1 == d2 && n1 < n2))
-		{
-			l1_data[l1->count_array] = o_next;
-			l1->count_array++;
-			l1->mbr = this->sum_mbr(l1->mbr, o_next.mbr); /*изменяем mbr всего листа*/
-		}
-		else
+		l->set_entry(l->count_array, info); /*добавляем значение в узел*/
+		l->count_array++;
+		l->mbr = l->count_array == 1 ? info.mbr : this->sum_mbr(l->mbr, info.mbr); /*если в узле 1 вершина, ставим mbr новых данных, иначе находим сумму*/
+		if constexpr (std::is_same_v<info_t, child_info_t>)
 		{
-			l2_data[l2->count_array] = o_next;
-			l2->count_array++;
-			l2->mbr = this->sum_mbr(l2->mbr, o_next.mbr); /*изменяем mbr всего листа*/
+			info.child->parent = l;
 		}
+		this->correct_tree(l, nullptr);
+		return;
 	}
-}
-
 
-R_template
-inline std::pair<typename R_class_area::data_info_t, typename R_class_area::data_info_t> 
-R_class_area::get_first_pair(std::vector<data_info_t>& q)
-{
-	size_t o1_index{}, o2_index{};
-	coord_type max_square{ std::numeric_limits<coord_type>::min() };
-	std::pair<data_info_t, data_info_t> ret{};
-	for (size_t i = 0; i < q.size(); i++)
+	if constexpr (insert_policy::forced_reinsert)
 	{
-		for (size_t j = 0; j < q.size(); j++)
+		/*первое переполнение уровня за одну вставку: дальние записи вставляются заново вместо деления*/
+		if (l != this->root && !(reinserted & (uint64_t(1) << level)))
 		{
-			if (i == j) continue;
-
-			coord_type tmp_square{ this->calc_square(this->sum_mbr(q[i].mbr, q[j].mbr)) - this->calc_square(q[i].mbr) - this->calc_square(q[j].mbr) };
-			if (tmp_square >= max_square)
+			reinserted |= uint64_t(1) << level;
+			std::array<info_t, max_nodes + 1> entries{ this->gather_entries(l, info) };
+			size_t keep{ insert_policy::template reinsert_split<max_nodes, metric_t>(entries) };
+			count_reinserts(entries.size() - keep);
+			this->fill_node(l, entries, 0, keep);
+			this->correct_tree(l, nullptr);
+			for (size_t i = keep; i < entries.size(); i++)
 			{
-				max_square = tmp_square;
-				o1_index = i;
-				o2_index = j;
+				this->insert_entry(entries[i], level, reinserted);
 			}
+			return;
 		}
 	}
-	ret.first = q[o1_index];
-	ret.second = q[o2_index];
-	q.erase(q.begin() + std::max(o1_index, o2_index));
-	q.erase(q.begin() + std::min(o1_index, o2_index));
 
-	return ret;
+	node_ptr_t new_node{ this->split_node(l, info) }; /*делим узел на два*/
+	this->correct_tree(l, new_node); /*корректируем дерево*/
 }
 
-
 R_template
-inline std::pair<typename R_class_area::child_info_t, typename R_class_area::child_info_t>
-R_class_area::get_first_pair(std::vector<child_info_t>& q) 
+template<typename info_t>
+inline std::array<info_t, max_nodes + 1> R_class_area::gather_entries(const node* v, const info_t& extra) const
 {
-	size_t o1_index{}, o2_index{};
-	coord_type max_square{ std::numeric_limits<coord_type>::min() };
-	std::pair<child_info_t, child_info_t> ret{};
-	for (size_t i = 0; i < q.size(); i++)
+	std::array<info_t, max_nodes + 1> entries{};
+	for (size_t i = 0; i < v->count_array; i++)
 	{
-		for (size_t j = 0; j < q.size(); j++)
-		{
-			if (i == j) continue;
-
-			coord_type tmp_square{ this->calc_square(this->sum_mbr(q[i].mbr, q[j].mbr)) - this->calc_square(q[i].mbr) - this->calc_square(q[j].mbr) };
-			if (tmp_square >= max_square)
-			{
-				max_square = tmp_square;
-				o1_index = i;
-				o2_index = j;
-			}
-		}
+		entries[i] = v->template get_entry<info_t>(i);
 	}
-	ret.first = q[o1_index];
-	ret.second = q[o2_index];
-	q.erase(q.begin() + std::max(o1_index, o2_index));
-	q.erase(q.begin() + std::min(o1_index, o2_index));
-
-	return ret;
+	entries[max_nodes] = extra;
+	return entries;
 }
 
-
 R_template
-inline typename R_class_area::data_info_t 
-R_class_area::get_next(node_ptr_t l1, node_ptr_t l2, std::vector<data_info_t>& q)
+template<typename info_t>
+inline void R_class_area::fill_node(node* v, const std::array<info_t, max_nodes + 1>& entries, size_t first, size_t last)
 {
-	size_t o_index{};
-	data_info_t o{};
-	coord_type max_diff_square{ std::numeric_limits<coord_type>::min() };
-	for (size_t i = 0; i < q.size(); i++)
+	for (size_t i = 0; i < max_nodes; i++) /*очистка v*/
 	{
-		coord_type d1{ this->calc_square(this->sum_mbr(l1->mbr,q[i].mbr)) - this->calc_square(l1->mbr) };
-		coord_type d2{ this->calc_square(this->sum_mbr(l2->mbr,q[i].mbr)) - this->calc_square(l2->mbr) };
-		coord_type a{ std::abs(d1 - d2) };
-
-		if (a >= max_diff_square)
-		{
-			max_diff_square = a;
-			o_index = i;
-		}
+		v->clear_entry(i);
+	}
+	for (size_t i = first; i < last; i++)
+	{
+		v->set_entry(i - first, entries[i]);
+	}
+	v->count_array = last - first;
+	this->recalc_mbr(v);
+	if (!v->leaf)
+	{
+		this->link_children(v);
 	}
-	o = q[o_index];
-	q.erase(q.begin() + o_index);
-	return o;
 }
 
 R_template
-inline typename R_class_area::child_info_t
-R_class_area::get_next(node_ptr_t l1, node_ptr_t l2, std::vector<child_info_t>& q)
+template<typename info_t>
+inline typename R_class_area::node_ptr_t R_class_area::split_node(node* l1, const info_t& extra)
 {
-	size_t o_index{};
-	child_info_t o{};
-	coord_type max_diff_square{ std::numeric_limits<coord_type>::min() };
-	for (size_t i = 0; i < q.size(); i++)
-	{
-		coord_type d1{ this->calc_square(this->sum_mbr(l1->mbr,q[i].mbr)) - this->calc_square(l1->mbr) };
-		coord_type d2{ this->calc_square(this->sum_mbr(l2->mbr,q[i].mbr)) - this->calc_square(l2->mbr) };
-		coord_type a{ std::abs(d1 - d2) };
-
-		if (a >= max_diff_square)
-		{
-			max_diff_square = a;
-			o_index = i;
-		}
-	}
-	o = q[o_index];
-	q.erase(q.begin() + o_index);
-	return o;
+	count_split();
+	std::array<info_t, max_nodes + 1> entries{ this->gather_entries(l1, extra) };
+	size_t k{ insert_policy::template split<min_nodes, metric_t>(entries) }; /*[0, k) остаются в l1, [k, max_nodes] уходят в l2*/
+
+	node_ptr_t l2(this->pool.create(l1->leaf));
+	this->fill_node(l1, entries, 0, k);
+	this->fill_node(l2, entries, k, entries.size());
+	return l2;
 }
 
 
 R_template
-inline void R_class_area::correct_tree(node_ptr_t l1, node_ptr_t l2)
+inline void R_class_area::correct_tree(node* l1, node_ptr_t l2)
 {
-	node_ptr_t v1{ l1 };
+	node* v1{ l1 };
 	node_ptr_t v2{ l2 };
 
 	while (true)
@@ -551,27 +968,25 @@ inline void R_class_area::correct_tree(node_ptr_t l1, node_ptr_t l2)
 		{
 			if (v2 != nullptr) /*и есть новая вершина -> произошло деление узлов*/
 			{
-				this->root.reset();
-				this->root = std::make_shared<node>(false); /*создание новой вершины*/
+				node_ptr_t old_root{ this->root };
+				this->root = this->pool.create(false); /*создание новой вершины*/
 
-				child_array_ptr_t& rref{ std::get<child_array_ptr_t>(this->root->data) }; /*сложим 2 листочка в корень*/
-				rref[this->root->count_array].child = v1;
-				rref[this->root->count_array].mbr = v1->mbr;
+				this->root->set_entry(this->root->count_array, child_info_t{ old_root, old_root->mbr }); /*сложим 2 листочка в корень*/
 				this->root->count_array++;
-				rref[this->root->count_array].child = v2;
-				rref[this->root->count_array].mbr = v2->mbr;
+				this->root->set_entry(this->root->count_array, child_info_t{ v2, v2->mbr });
 				this->root->count_array++;
-				this->root->mbr = this->sum_mbr(v1->mbr, v2->mbr);
+				this->root->mbr = this->sum_mbr(old_root->mbr, v2->mbr);
+				this->link_children(this->root);
+				this->height++;
 			}
 			return;
 		}
 
 		/*если v1 не корень*/
-		node_ptr_t p{ this->get_parent(this->root, v1) }; /*находим родителя v1*/
-		child_array_ptr_t& rref{ std::get<child_array_ptr_t>(p->data) }; /*находим запись о v1 в p*/
-		child_info_t& info{ *std::find_if(rref.begin(), rref.begin() + p->count_array, [&v1](const child_info_t& v) {return v1 == v.child; }) };
-		info.mbr = v1->mbr; /*обновляем mbr в записи у родителя v1*/
-		p->mbr = this->sum_mbr(p->mbr, v1->mbr); /*обновляем общий mbr у предка*/
+		node* p{ v1->parent }; /*родитель v1*/
+		count_parent_step();
+		p->set_mbr(p->index_of(v1), v1->mbr); /*обновляем mbr в записи у родителя v1*/
+		this->recalc_mbr(p); /*пересчитываем общий mbr у предка: после деления или повторной вставки v1 мог уменьшиться*/
 		v1 = p; /*изменяем v1*/
 
 		if (v2 != nullptr)
@@ -579,44 +994,205 @@ inline void R_class_area::correct_tree(node_ptr_t l1, node_ptr_t l2)
 			child_info_t pv2{ v2, v2->mbr };
 			if (p->count_array < max_nodes) /*если новая запись влезает*/
 			{
-				child_array_ptr_t& rref{ std::get<child_array_ptr_t>(p->data) };
-				rref[p->count_array] = pv2;
+				p->set_entry(p->count_array, pv2);
 				p->count_array++;
 				p->mbr = this->sum_mbr(p->mbr, pv2.mbr); /*обновляем общий mbr у предка*/
+				v2->parent = p;
 				v2 = nullptr;
 			}
 			else /*делим предка*/
 			{
-				v2 = this->node_division(p, pv2);
+				v2 = this->split_node(p, pv2);
 			}
 		}
 	}
 }
 
 R_template
-inline typename R_class_area::node_ptr_t R_class_area::get_parent(node_ptr_t where, const node_ptr_t& what) const
+inline void R_class_area::link_children(node* v) const
 {
-	if (!where->leaf) /*если текущая позиция не листочек*/
+	for (size_t i = 0; i < v->count_array; i++)
 	{
-		child_array_ptr_t& ref{ std::get<child_array_ptr_t>(where->data) };
-		for (size_t i = 0; i < where->count_array; i++)
+		v->child(i)->parent = v;
+	}
+}
+
+R_template
+inline void R_class_area::recalc_mbr(node* v) const
+{
+	if (v->count_array == 0)
+	{
+		v->mbr = mbr_t{};
+		return;
+	}
+	v->mbr = v->get_mbr(0);
+	for (size_t i = 1; i < v->count_array; i++)
+	{
+		v->mbr = this->sum_mbr(v->mbr, v->get_mbr(i));
+	}
+}
+
+
+R_template
+template<typename convert_t>
+inline size_t R_class_area::write_image(std::vector<char>& image, convert_t&& convert) const
+{
+	using stored_t = std::decay_t<decltype(convert(std::declval<const data_type&>()))>;
+	static_assert(std::is_trivially_copyable_v<stored_t> && alignof(stored_t) <= 8, "объекты образа хранятся побайтно");
+	static_assert(alignof(coord_type) <= 8, "координаты образа выровнены по 8 байт");
+
+	/*узлы в порядке обхода в ширину: потомки каждого узла попадают в order подряд*/
+	std::vector<const node*> order{ this->root };
+	size_t object_count{};
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const node* v{ order[i] };
+		if (v->leaf)
+		{
+			object_count += v->count_array;
+			continue;
+		}
+		for (size_t j = 0; j < v->count_array; j++)
+		{
+			order.push_back(v->child(j));
+		}
+	}
+
+	/*смещения записей узлов от начала раздела узлов: потомкам нужны смещения до записи родителя*/
+	std::vector<size_t> records(order.size() + 1);
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		records[i + 1] = records[i] + frozen_record_size(order[i]->count_array, order[i]->leaf, num_dims, sizeof(coord_type), sizeof(stored_t));
+	}
+
+	frozen_header header{};
+	header.magic = frozen_magic;
+	header.version = frozen_version;
+	header.num_dims = uint32_t(num_dims);
+	header.coord_size = uint32_t(sizeof(coord_type));
+	header.data_size = uint32_t(sizeof(stored_t));
+	header.height = uint32_t(this->height);
+	header.node_count = order.size();
+	header.object_count = object_count;
+	header.root = frozen_node{ uint32_t(this->root->count_array), uint32_t(this->root->leaf), 0 };
+	header.nodes = frozen_align(sizeof(frozen_header));
+	header.bytes = frozen_align(header.nodes + records.back() + frozen_box_tail * sizeof(coord_type));
+
+	size_t offset{ frozen_align(image.size()) };
+	image.resize(offset + header.bytes);
+	char* base{ image.data() + offset };
+	std::memcpy(base, &header, sizeof(frozen_header));
+
+	size_t next_node{ 1 };
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const node* v{ order[i] };
+		const size_t count{ v->count_array };
+		char* record{ base + header.nodes + records[i] };
+		char* entries{ record + frozen_entries_offset(count, num_dims, sizeof(coord_type)) };
+
+		coord_type* box{ reinterpret_cast<coord_type*>(record) };
+		for (size_t d = 0; d < num_dims; d++)
 		{
-			/*поиск исключительно по указателям*/
-			if (ref[i].child == what) 
+			for (size_t j = 0; j < count; j++)
 			{
-				return where;
+				box[d * count + j] = v->boxes.ld[d][j];
+				box[(num_dims + d) * count + j] = v->boxes.ru[d][j];
 			}
-			else
+		}
+
+		if (v->leaf)
+		{
+			for (size_t j = 0; j < count; j++)
 			{
-				node_ptr_t find_ptr{ this->get_parent(ref[i].child, what) };
-				if (find_ptr != nullptr)
-					return find_ptr;
+				stored_t stored{ convert(v->object(j)) };
+				std::memcpy(entries + j * sizeof(stored_t), &stored, sizeof(stored_t));
 			}
- 		}
+		}
+		else
+		{
+			for (size_t j = 0; j < count; j++)
+			{
+				const node* c{ v->child(j) };
+				frozen_node child{ uint32_t(c->count_array), uint32_t(c->leaf), records[next_node + j] };
+				std::memcpy(entries + j * sizeof(frozen_node), &child, sizeof(frozen_node));
+			}
+			next_node += count;
+		}
 	}
-	return nullptr;
+	return offset;
+}
+
+R_template
+template<typename convert_t>
+inline bool R_class_area::save_image(const char* path, convert_t&& convert) const
+{
+	std::vector<char> image{};
+	this->write_image(image, std::forward<convert_t>(convert));
+	return save_image_file(path, image);
 }
 
+R_template
+template<typename convert_t>
+inline typename R_class_area::template frozen_t<convert_t> R_class_area::freeze(convert_t&& convert) const
+{
+	std::vector<char> image{};
+	this->write_image(image, std::forward<convert_t>(convert));
+	return frozen_t<convert_t>(std::move(image));
+}
+
+R_template
+inline Frozen_R_tree<data_type, coord_type, num_dims, float_type> R_class_area::freeze() const
+{
+	return this->freeze([](const data_type& data) { return data; });
+}
+
+R_template
+inline R_shape R_class_area::shape() const
+{
+	R_shape report{ max_nodes, min_nodes, this->height, 0, std::vector<R_level_shape>(this->height) };
+	this->shape(this->root, this->height - 1, report);
+	return report;
+}
+
+R_template
+inline void R_class_area::shape(const node* v, size_t level, R_shape& report) const
+{
+	R_level_shape& info{ report.levels[level] };
+	info.nodes++;
+	info.entries += v->count_array;
+	if (v != this->root)
+	{
+		info.min_entries = std::min(info.min_entries, v->count_array);
+		info.underfull += v->count_array < min_nodes;
+	}
+
+	double covered{};
+	for (size_t i = 0; i < v->count_array; i++)
+	{
+		const mbr_t m{ v->get_mbr(i) };
+		covered += mbr_area<double>(m);
+		for (size_t j = i + 1; j < v->count_array; j++)
+		{
+			double overlap{ mbr_overlap<double>(m, v->get_mbr(j)) };
+			info.overlap += overlap;
+			covered -= overlap;
+		}
+	}
+	double volume{ mbr_area<double>(v->mbr) };
+	info.volume += volume;
+	info.dead_space += std::max(volume - std::max(covered, 0.0), 0.0);
+
+	if (v->leaf)
+	{
+		report.objects += v->count_array;
+		return;
+	}
+	for (size_t i = 0; i < v->count_array; i++)
+	{
+		this->shape(v->child(i), level - 1, report);
+	}
+}
 
 R_template
 inline void R_class_area::print(size_t level, std::function<void(int, void*)> handler_data) const
@@ -665,12 +1241,7 @@ inline void R_class_area::print(const node_ptr_t& to_print, size_t& level, std::
 				if (k != 0)
 					std::cout << ", ";
 
-				if (to_print->leaf)
-				{
-					std::cout << (j == 0 ? std::get<data_array_t>(to_print->data)[i].mbr.ld[k] : std::get<data_array_t>(to_print->data)[i].mbr.ru[k]);
-				}
-				else
-					std::cout << (j == 0 ? std::get<child_array_ptr_t>(to_print->data)[i].mbr.ld[k] : std::get<child_array_ptr_t>(to_print->data)[i].mbr.ru[k]);
+				std::cout << (j == 0 ? to_print->get_mbr(i).ld[k] : to_print->get_mbr(i).ru[k]);
 			}
 			std::cout << (j == 0 ? "), " : ")");
 		}
@@ -695,7 +1266,7 @@ inline void R_class_area::print(const node_ptr_t& to_print, size_t& level, std::
 				{
 					if (k != 0)
 						std::cout << ", ";
-					std::cout << (j == 0 ? std::get<data_array_t>(to_print->data)[i].mbr.ld[k] : std::get<data_array_t>(to_print->data)[i].mbr.ru[k]);
+					std::cout << (j == 0 ? to_print->get_mbr(i).ld[k] : to_print->get_mbr(i).ru[k]);
 				}
 				std::cout << (j == 0 ? "), " : ")");
 			}
@@ -709,7 +1280,7 @@ inline void R_class_area::print(const node_ptr_t& to_print, size_t& level, std::
 			{
 				std::cout << "    ";
 			}
-			handler_data(int(level + 1), (void*)&std::get<data_array_t>(to_print->data)[i].data);
+			handler_data(int(level + 1), (void*)&to_print->object(i));
 		}
 	}
 	else
@@ -717,7 +1288,7 @@ inline void R_class_area::print(const node_ptr_t& to_print, size_t& level, std::
 		level++;
 		for (size_t i = 0; i < to_print->count_array; i++)
 		{
-			this->print(std::get<child_array_ptr_t>(to_print->data)[i].child, level, handler_data);
+			this->print(to_print->child(i), level, handler_data);
 		}
 		level--;
 	}
@@ -726,6 +1297,7 @@ inline void R_class_area::print(const node_ptr_t& to_print, size_t& level, std::
 R_template
 inline const data_type& R_class_area::find(const mbr_t& mbr, bool& success) const
 {
+	typename stats_policy::scope scope{};
 	if (this->include_mbr(this->root->mbr, mbr))
 	{
 		if (this->root->count_array)
@@ -742,25 +1314,21 @@ inline const data_type& R_class_area::find(const mbr_t& mbr, bool& success) cons
 R_template
 inline const data_type& R_class_area::find(const node_ptr_t& v, const mbr_t& mbr, bool& success) const
 {
+	count_visit(v->count_array);
+	uint64_t hits{ v->match(mbr_test::covers, mbr) };
 	if (!v->leaf)
 	{
-		for (size_t i = 0; i < v->count_array; i++)
+		if (hits)
 		{
-			if (this->include_mbr(std::get<child_array_ptr_t>(v->data)[i].mbr, mbr))
-			{
-				return this->find(std::get<child_array_ptr_t>(v->data)[i].child, mbr, success);
-			}
+			return this->find(v->child(mbr_first_bit(hits)), mbr, success);
 		}
 	}
 	else
 	{
-		for (size_t i = 0; i < v->count_array; i++)
+		if (hits)
 		{
-			if (this->include_mbr(std::get<data_array_t>(v->data)[i].mbr, mbr))
-			{
-				success = true;
-				return std::get<data_array_t>(v->data)[i].data;
-			}
+			success = true;
+			return v->object(mbr_first_bit(hits));
 		}
 		success = false;
 		return this->error_data;
@@ -773,8 +1341,8 @@ inline const data_type& R_class_area::find(const node_ptr_t& v, const mbr_t& mbr
 R_template
 inline void R_class_area::remove(const mbr_t& mbr, const data_type& data)
 {
-	node_ptr_t v{ this->root };
-	node_ptr_t l{ this->find_object(v, mbr, data) };
+	typename stats_policy::scope scope{};
+	node* l{ this->find_object(this->root, mbr, data) };
 	
 	if (l == nullptr)
 	{
@@ -782,76 +1350,99 @@ inline void R_class_area::remove(const mbr_t& mbr, const data_type& data)
 		return;
 	}
 
-	data_array_t& info{ std::get<data_array_t>(l->data) }; /*удаляем data из l*/
-	size_t del_index{};
-	for (size_t i = 0; i < l->count_array; i++) /*поиск его места в массиве*/
+	this->remove_entry(l, l->index_of(data));
+}
+
+R_template
+inline bool R_class_area::update(const data_type& data, const mbr_t& old_mbr, const mbr_t& new_mbr)
+{
+	typename stats_policy::scope scope{};
+	node* l{ this->find_object(this->root, old_mbr, data) };
+
+	if (l == nullptr)
+	{
+		return false;
+	}
+
+	size_t index{ l->index_of(data) };
+	if (l != this->root && !this->include_mbr(l->parent->mbr, new_mbr)) /*не помещается у родителя: удаляем и вставляем заново*/
+	{
+		this->remove_entry(l, index);
+		this->insert(data, new_mbr);
+		return true;
+	}
+
+	l->set_mbr(index, new_mbr);
+	for (node* v = l; v != nullptr; v = v->parent) /*mbr родителя не растет, поэтому выше он может только уменьшиться*/
 	{
-		if (info[i].data == data)
+		mbr_t before{ v->mbr };
+		this->recalc_mbr(v);
+		if (before.ld == v->mbr.ld && before.ru == v->mbr.ru)
 		{
-			del_index = i;
 			break;
 		}
+		if (v->parent != nullptr)
+		{
+			count_parent_step();
+			v->parent->set_mbr(v->parent->index_of(v), v->mbr);
+		}
 	}
+	return true;
+}
+
+R_template
+inline void R_class_area::remove_entry(node* l, size_t del_index)
+{
 	for (size_t i = del_index; i < l->count_array - 1; ++i) /*удаление нужного элемента*/
 	{
-		info[i] = info[i + 1];
+		l->move_entry(i, i + 1);
 	}
 	l->count_array--;
+	l->clear_entry(l->count_array);
 
-	v = l;
+	node* v{ l };
 	std::vector<data_info_t> ql{};
 	std::vector<child_info_t> qn{};
 
-	while (v != this->root)
+	while (v != this->root) /*поднимаемся только по пути от листа к корню*/
 	{
-		node_ptr_t p{ this->get_parent(this->root, v) }; /*родитель v*/
-		child_array_ptr_t& rref{ std::get<child_array_ptr_t>(p->data) }; /*находим запись о v в p*/
-		child_info_t& info{ *std::find_if(rref.begin(), rref.begin() + p->count_array, [&v](const child_info_t& inf) {return v == inf.child; }) };
-		if (v->count_array < min_nodes) /*удаляем запись info из p*/
+		node* p{ v->parent }; /*родитель v*/
+		count_parent_step();
+		size_t v_index{ p->index_of(v) }; /*находим запись о v в p*/
+		if (v->count_array < min_nodes) /*удаляем запись о v из p*/
 		{
-			size_t del_index{};
-			for (size_t i = 0; i < p->count_array; i++)
+			for (size_t i = v_index; i < p->count_array - 1; ++i) /*удаление нужного элемента*/
 			{
-				if (rref[i].child == info.child)
-				{
-					del_index = i;
-					break;
-				}
-			}
-			for (size_t i = del_index; i < p->count_array - 1; ++i) /*удаление нужного элемента*/
-			{
-				rref[i] = rref[i + 1];
+				p->move_entry(i, i + 1);
 			}
 			p->count_array--;
-			rref[p->count_array].child = nullptr;
-			rref[p->count_array].mbr = mbr_t{};
+			p->clear_entry(p->count_array);
 			for (size_t i = 0; i < v->count_array; i++)
 			{
 				if (v->leaf)
-					ql.push_back(std::get<data_array_t>(v->data)[i]);
+					ql.push_back(v->get_object(i));
 				else
-					qn.push_back(std::get<child_array_ptr_t>(v->data)[i]);
+					qn.push_back(v->get_child(i));
 			}
+			this->pool.destroy(v);
 		}
 		else
 		{
-			v->mbr = v->leaf ? std::get<data_array_t>(v->data)[0].mbr : std::get<child_array_ptr_t>(v->data)[0].mbr;
-			for (size_t i = 0; i < v->count_array; i++)
-			{
-				v->mbr = this->sum_mbr(v->mbr, v->leaf ? std::get<data_array_t>(v->data)[i].mbr : std::get<child_array_ptr_t>(v->data)[i].mbr);
-			}
+			this->recalc_mbr(v);
+			p->set_mbr(v_index, v->mbr); /*обновляем запись о v у родителя*/
 		}
 		v = p;
 	}
+	this->recalc_mbr(v);
 	if (v->count_array == 1 && !v->leaf)
 	{
-		this->root = std::get<child_array_ptr_t>(v->data)[0].child;
-	}
-	else if (v->count_array == 0)
-	{
-		this->root->mbr = mbr_t{};
+		this->root = v->child(0);
+		this->root->parent = nullptr;
+		this->pool.destroy(v);
+		this->height--;
 	}
 
+	count_reinserts(ql.size());
 	for (size_t i = 0; i < ql.size(); i++) /*закидываем вырезанные данные в листах*/
 	{
 		this->insert(ql[i].data, ql[i].mbr);
@@ -859,6 +1450,8 @@ inline void R_class_area::remove(const mbr_t& mbr, const data_type& data)
 	for (size_t i = 0; i < qn.size(); i++) /*закидываем вырезанные данные в узлах*/
 	{
 		std::vector<data_info_t> tmp{ this->get_all_data(qn[i].child) }; 
+		this->free_subtree(qn[i].child);
+		count_reinserts(tmp.size());
 		for (size_t j = 0; j < tmp.size(); j++)
 		{
 			this->insert(tmp[j].data, tmp[j].mbr);
@@ -867,22 +1460,237 @@ inline void R_class_area::remove(const mbr_t& mbr, const data_type& data)
 }
 
 R_template
-inline typename R_class_area::node_ptr_t R_class_area::find_object(node_ptr_t v, const mbr_t& mbr, const data_type& data) const
+template<typename range_t>
+inline size_t R_class_area::remove_batch(const range_t& items)
+{
+	typename stats_policy::scope scope{};
+	tombstones_t tombstones{};
+	for (const entry_t& item : items)
+	{
+		this->mark_object(this->root, item.second, item.first, tombstones);
+	}
+	return this->condense(tombstones);
+}
+
+R_template
+template<typename predicate_t>
+inline size_t R_class_area::remove_if(predicate_t&& predicate)
+{
+	return this->remove_if(mbr_test::intersects, this->root->mbr, std::forward<predicate_t>(predicate));
+}
+
+R_template
+template<typename predicate_t>
+inline size_t R_class_area::remove_if(mbr_test test, const mbr_t& mbr, predicate_t&& predicate)
+{
+	typename stats_policy::scope scope{};
+	if (this->root->count_array == 0 || !this->test_mbr(mbr_node_test(test), this->root->mbr, mbr))
+		return 0;
+
+	tombstones_t tombstones{};
+	mbr_dispatch(test, [&](auto t)
+		{
+			this->template mark_if<decltype(t)::value>(this->root, mbr, predicate, tombstones);
+			return true;
+		});
+	return this->condense(tombstones);
+}
+
+R_template
+inline bool R_class_area::mark_object(node* v, const mbr_t& mbr, const data_type& data, tombstones_t& tombstones) const
+{
+	count_visit(v->count_array);
+	uint64_t hits{ v->match(mbr_test::covers, mbr) };
+	if (!v->leaf)
+	{
+		while (hits)
+		{
+			size_t i{ mbr_first_bit(hits) };
+			hits &= hits - 1;
+			if (this->mark_object(v->child(i), mbr, data, tombstones))
+				return true;
+		}
+		return false;
+	}
+
+	auto it{ tombstones.find(v) };
+	if (it != tombstones.end())
+		hits &= ~it->second; /*уже помеченные записи не помечаются второй раз*/
+	while (hits)
+	{
+		size_t i{ mbr_first_bit(hits) };
+		hits &= hits - 1;
+		if (v->object(i) == data)
+		{
+			tombstones[v] |= uint64_t(1) << i;
+			return true;
+		}
+	}
+	return false;
+}
+
+R_template
+template<mbr_test test, typename predicate_t>
+inline void R_class_area::mark_if(node* v, const mbr_t& mbr, predicate_t& predicate, tombstones_t& tombstones) const
 {
+	count_visit(v->count_array);
 	if (!v->leaf)
 	{
-		bool is_find{ false };
-		node_ptr_t finded{};
-		for (size_t i = 0; i < v->count_array; i++)
+		uint64_t hits{ v->template match<mbr_node_test(test)>(mbr) };
+		while (hits)
 		{
-			if (this->include_mbr(std::get<child_array_ptr_t>(v->data)[i].mbr, mbr))
+			size_t i{ mbr_first_bit(hits) };
+			hits &= hits - 1;
+			this->template mark_if<test>(v->child(i), mbr, predicate, tombstones);
+		}
+		return;
+	}
+
+	uint64_t hits{ v->template match<test>(mbr) }, marked{};
+	count_hits(hits);
+	while (hits)
+	{
+		size_t i{ mbr_first_bit(hits) };
+		hits &= hits - 1;
+		if (predicate(static_cast<const data_type&>(v->object(i))))
+			marked |= uint64_t(1) << i;
+	}
+	if (marked)
+		tombstones.emplace(v, marked);
+}
+
+R_template
+inline size_t R_class_area::condense(const tombstones_t& tombstones)
+{
+	if (tombstones.empty())
+		return 0;
+
+	/*затронутые узлы по уровням (0 - листья): узел попадает в список уровня, когда меняется его потомок*/
+	std::vector<std::vector<node*>> dirty(this->height);
+	size_t removed{};
+	for (const std::pair<node* const, uint64_t>& t : tombstones)
+	{
+		node* l{ t.first };
+		size_t kept{};
+		for (size_t i = 0; i < l->count_array; i++) /*вырезание помеченных записей с сохранением порядка остальных*/
+		{
+			if (t.second & (uint64_t(1) << i))
+				continue;
+			if (kept != i)
+				l->move_entry(kept, i);
+			kept++;
+		}
+		for (size_t i = kept; i < l->count_array; i++)
+		{
+			l->clear_entry(i);
+		}
+		removed += l->count_array - kept;
+		l->count_array = kept;
+		dirty[0].push_back(l);
+	}
+
+	std::vector<data_info_t> ql{};
+	std::vector<std::pair<child_info_t, size_t>> qn{}; /*вырезанные поддеревья и уровень узла, в котором они лежали*/
+	for (size_t level = 0; level < dirty.size(); level++)
+	{
+		std::vector<node*>& nodes{ dirty[level] };
+		std::sort(nodes.begin(), nodes.end());
+		nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+		for (node* v : nodes)
+		{
+			if (v == this->root)
+			{
+				this->recalc_mbr(v);
+				continue;
+			}
+
+			node* p{ v->parent };
+			size_t v_index{ p->index_of(v) };
+			count_parent_step();
+			if (v->count_array < min_nodes) /*недозаполненный узел убирается, записи вставляются заново*/
 			{
-				finded = this->find_object(std::get<child_array_ptr_t>(v->data)[i].child, mbr, data);
-				if (finded != nullptr)
+				for (size_t i = v_index; i < p->count_array - 1; ++i)
 				{
-					is_find = true;
-					break;
+					p->move_entry(i, i + 1);
 				}
+				p->count_array--;
+				p->clear_entry(p->count_array);
+				for (size_t i = 0; i < v->count_array; i++)
+				{
+					if (v->leaf)
+						ql.push_back(v->get_object(i));
+					else
+						qn.emplace_back(v->get_child(i), level);
+				}
+				this->pool.destroy(v);
+			}
+			else
+			{
+				this->recalc_mbr(v);
+				p->set_mbr(v_index, v->mbr);
+			}
+			dirty[level + 1].push_back(p);
+		}
+	}
+
+	count_reinserts(ql.size() + qn.size());
+	while (!this->root->leaf && this->root->count_array <= 1) /*корень с одним потомком заменяется потомком*/
+	{
+		node* old_root{ this->root };
+		if (old_root->count_array == 0)
+		{
+			this->root = this->pool.create(true);
+			this->height = 1;
+		}
+		else
+		{
+			this->root = old_root->child(0);
+			this->root->parent = nullptr;
+			this->height--;
+		}
+		this->pool.destroy(old_root);
+	}
+
+	std::sort(qn.begin(), qn.end(), [](const std::pair<child_info_t, size_t>& a, const std::pair<child_info_t, size_t>& b)
+		{
+			return a.second > b.second;
+		});
+	for (const std::pair<child_info_t, size_t>& entry : qn) /*поддеревья - на свой уровень, без разбора на объекты*/
+	{
+		if (entry.second < this->height && this->root->count_array)
+		{
+			uint64_t reinserted{};
+			this->insert_entry(entry.first, entry.second, reinserted);
+			continue;
+		}
+		std::vector<data_info_t> tmp{ this->get_all_data(entry.first.child) }; /*дерево стало ниже поддерева*/
+		count_reinserts(tmp.size() - 1); /*поддерево уже посчитано одной записью*/
+		this->free_subtree(entry.first.child);
+		ql.insert(ql.end(), tmp.begin(), tmp.end());
+	}
+	for (const data_info_t& entry : ql)
+	{
+		this->insert(entry.data, entry.mbr);
+	}
+	return removed;
+}
+
+R_template
+inline typename R_class_area::node* R_class_area::find_object(node* v, const mbr_t& mbr, const data_type& data) const
+{
+	count_visit(v->count_array);
+	if (!v->leaf)
+	{
+		node* finded{};
+		uint64_t hits{ v->match(mbr_test::covers, mbr) };
+		while (hits)
+		{
+			size_t i{ mbr_first_bit(hits) };
+			hits &= hits - 1;
+			finded = this->find_object(v->child(i), mbr, data);
+			if (finded != nullptr)
+			{
+				break;
 			}
 		}
 		return finded;
@@ -891,7 +1699,7 @@ inline typename R_class_area::node_ptr_t R_class_area::find_object(node_ptr_t v,
 	{
 		for (size_t i = 0; i < v->count_array; i++)
 		{
-			if (std::get<data_array_t>(v->data)[i].data == data)
+			if (v->object(i) == data)
 			{
 				return v;
 			}
@@ -910,7 +1718,7 @@ inline std::vector<typename R_class_area::data_info_t> R_class_area::get_all_dat
 	{
 		for (size_t i = 0; i < where->count_array; i++)
 		{
-			std::vector<data_info_t> tmp{ this->get_all_data(std::get<child_array_ptr_t>(where->data)[i].child) };
+			std::vector<data_info_t> tmp{ this->get_all_data(where->child(i)) };
 			ql.insert
 			(
 				ql.end(),
@@ -923,25 +1731,113 @@ inline std::vector<typename R_class_area::data_info_t> R_class_area::get_all_dat
 	{
 		for (size_t i = 0; i < where->count_array; i++)
 		{
-			ql.push_back(data_info_t{ std::get<data_array_t>(where->data)[i].data, std::get<data_array_t>(where->data)[i].mbr });
+			ql.push_back(where->get_object(i));
 		}
 	}
 	return ql;
 }
 
 R_template
-inline size_t R_class_area::search(bool is_range, const mbr_t& mbr, const callback_t& callback, void* context)
+template<typename packing_t, typename range_t>
+inline void R_class_area::bulk_load(const range_t& items)
+{
+	typename stats_policy::scope scope{};
+	std::vector<data_info_t> q{ this->get_all_data(this->root) }; /*старое содержимое упаковывается вместе с новым*/
+	for (const entry_t& item : items)
+	{
+		q.push_back(data_info_t{ item.first, item.second });
+	}
+	this->free_subtree(this->root);
+
+	packing_t::template order<max_nodes>(q, true);
+	std::vector<child_info_t> level{ this->pack_level(q, true) };
+	this->height = 1;
+	while (level.size() > 1) /*строим уровни, пока не останется один узел - корень*/
+	{
+		packing_t::template order<max_nodes>(level, false);
+		level = this->pack_level(level, false);
+		this->height++;
+	}
+
+	if (level.empty())
+	{
+		this->root = this->pool.create(true);
+	}
+	else
+	{
+		this->root = level[0].child;
+		this->root->parent = nullptr;
+	}
+}
+
+R_template
+template<typename info_t>
+inline std::vector<typename R_class_area::child_info_t> R_class_area::pack_level(const std::vector<info_t>& q, bool leaf)
+{
+	std::vector<child_info_t> packed{};
+	packed.reserve(q.size() / max_nodes + 1);
+
+	size_t begin{};
+	while (begin < q.size())
+	{
+		size_t count{ std::min(max_nodes, q.size() - begin) };
+		size_t rest{ q.size() - begin - count };
+		if (rest > 0 && rest < min_nodes) /*два последних узла делят остаток, чтобы не было недозаполненного узла*/
+		{
+			count = (count + rest + 1) / 2;
+		}
+
+		node_ptr_t v{ this->pool.create(leaf) };
+		for (size_t i = 0; i < count; i++)
+		{
+			v->set_entry(i, q[begin + i]);
+		}
+		v->count_array = count;
+		this->recalc_mbr(v);
+		if (!leaf)
+		{
+			this->link_children(v);
+		}
+		packed.push_back(child_info_t{ v, v->mbr });
+		begin += count;
+	}
+	return packed;
+}
+
+R_template
+inline void R_class_area::free_subtree(node_ptr_t where)
+{
+	if (!where->leaf)
+	{
+		for (size_t i = 0; i < where->count_array; i++)
+		{
+			this->free_subtree(where->child(i));
+		}
+	}
+	this->pool.destroy(where);
+}
+
+R_template
+inline size_t R_class_area::search(mbr_test test, const mbr_t& mbr, const callback_t& callback, void* context) const
+{
+	return this->search(test, mbr, [&callback, context](const data_type& id) { return callback(id, context); });
+}
+
+R_template
+template<typename visitor_t>
+inline size_t R_class_area::search(mbr_test test, const mbr_t& mbr, visitor_t&& visitor) const
 {
+	typename stats_policy::scope scope{};
 	size_t count_founded{};
 
-	if (this->root)
+	if (this->root && this->root->count_array)
 	{
-		if (this->include_mbr(
-			is_range ? mbr : this->root->mbr,
-			is_range ? this->root->mbr : mbr
-		))
+		if (this->test_mbr(mbr_node_test(test), this->root->mbr, mbr))
 		{
-			this->search(is_range, this->root, mbr, count_founded, callback, context);
+			mbr_dispatch(test, [&](auto t)
+				{
+					return this->template search<decltype(t)::value>(this->root, mbr, count_founded, visitor);
+				});
 			return count_founded;
 		}
 		return 0u;
@@ -951,46 +1847,37 @@ inline size_t R_class_area::search(bool is_range, const mbr_t& mbr, const callba
 }
 
 R_template
-inline bool R_class_area::search(bool is_range, const node_ptr_t& v, const mbr_t& mbr, size_t& count_found, const callback_t& callback, void* context)
+template<mbr_test test, typename visitor_t>
+inline bool R_class_area::search(const node* v, const mbr_t& mbr, size_t& count_found, visitor_t& visitor) const
 {
+	count_visit(v->count_array);
 	if (!v->leaf) /*если не листок*/
 	{
-		for (size_t i = 0; i < v->count_array; i++)
+		uint64_t hits{ v->template match<mbr_node_test(test)>(mbr) }; /*все записи узла проверяются за один проход, во внутренних узлах - проверка поддеревьев*/
+		while (hits)
 		{
-			/*std::cout << "-{(" << mbr.ld[0] << ", " << mbr.ld[1] << "), (" << mbr.ru[0] << ", " << mbr.ru[1] << ")" << std::endl;
-			std::cout << "+{(" << std::get<child_array_ptr_t>(v->data)[i].mbr.ld[0] << ", " << std::get<child_array_ptr_t>(v->data)[i].mbr.ld[1] 
-				<< "), (" << std::get<child_array_ptr_t>(v->data)[i].mbr.ru[0] << ", " << std::get<child_array_ptr_t>(v->data)[i].mbr.ru[1] << ")" << std::endl;*/
-			if (this->include_mbr(
-				is_range ? mbr : std::get<child_array_ptr_t>(v->data)[i].mbr,
-				is_range ? std::get<child_array_ptr_t>(v->data)[i].mbr : mbr
-			)) /*если входит в мбр*/
+			size_t i{ mbr_first_bit(hits) };
+			hits &= hits - 1;
+			if (!this->template search<test>(v->child(i), mbr, count_found, visitor))  /*если функция вернула 0, прекращаем поиск*/
 			{
-				if (!this->search(is_range, std::get<child_array_ptr_t>(v->data)[i].child, mbr, count_found, callback, context))  /*если функция вернула 0, прекращаем поиск*/
-				{
-					return false;
-				}
+				return false;
 			}
 		}
 	}
 	else
 	{
-		for (size_t i = 0; i < v->count_array; i++)
+		uint64_t hits{ v->template match<test>(mbr) };
+		count_hits(hits);
+		while (hits)
 		{
-			/*std::cout << "-{(" << mbr.ld[0] << ", " << mbr.ld[1] << "), (" << mbr.ru[0] << ", " << mbr.ru[1] << ")" << std::endl;
-			std::cout << "+{(" << std::get<data_array_t>(v->data)[i].mbr.ld[0] << ", " << std::get<data_array_t>(v->data)[i].mbr.ld[1]
-				<< "), (" << std::get<data_array_t>(v->data)[i].mbr.ru[0] << ", " << std::get<data_array_t>(v->data)[i].mbr.ru[1] << ")" << std::endl;*/
-			if (this->include_mbr(
-				is_range ? mbr : std::get<data_array_t>(v->data)[i].mbr,
-				is_range ? std::get<data_array_t>(v->data)[i].mbr : mbr
-			)) /*если входит в мбр*/
-			{
-				data_type& id{ std::get<data_array_t>(v->data)[i].data };
-				count_found++;
+			size_t i{ mbr_first_bit(hits) };
+			hits &= hits - 1;
+			const data_type& id{ v->object(i) };
+			count_found++;
 
-				if (!callback(id, context)) /*если функция вернула 0, прекращаем поиск*/
-				{
-					return false;
-				}
+			if (!visitor(id)) /*если функция вернула 0, прекращаем поиск*/
+			{
+				return false;
 			}
 		}
 	}
@@ -999,21 +1886,172 @@ inline bool R_class_area::search(bool is_range, const node_ptr_t& v, const mbr_t
 }
 
 R_template
-inline size_t R_class_area::search_in_range(const mbr_t& mbr, const callback_t& callback, void* context)
+inline size_t R_class_area::search_in_range(const mbr_t& mbr, const callback_t& callback, void* context) const
+{
+	return this->search(mbr_test::inside, mbr, callback, context);
+}
+
+R_template
+template<typename visitor_t>
+inline size_t R_class_area::search_in_range(const mbr_t& mbr, visitor_t&& visitor) const
+{
+	return this->search(mbr_test::inside, mbr, std::forward<visitor_t>(visitor));
+}
+
+R_template
+inline size_t R_class_area::search_objects(const mbr_t& mbr, const callback_t& callback, void* context) const
+{
+	return this->search(mbr_test::covers, mbr, callback, context);
+}
+
+R_template
+template<typename visitor_t>
+inline size_t R_class_area::search_objects(const mbr_t& mbr, visitor_t&& visitor) const
+{
+	return this->search(mbr_test::covers, mbr, std::forward<visitor_t>(visitor));
+}
+
+R_template
+inline size_t R_class_area::search_intersecting(const mbr_t& mbr, const callback_t& callback, void* context) const
+{
+	return this->search(mbr_test::intersects, mbr, callback, context);
+}
+
+R_template
+template<typename visitor_t>
+inline size_t R_class_area::search_intersecting(const mbr_t& mbr, visitor_t&& visitor) const
+{
+	return this->search(mbr_test::intersects, mbr, std::forward<visitor_t>(visitor));
+}
+
+R_template
+inline typename R_class_area::query_cursor R_class_area::query(mbr_test test, const mbr_t& mbr) const
+{
+	query_cursor cursor{};
+	cursor.open(*this, test, mbr);
+	return cursor;
+}
+
+R_template
+template<typename distance_t, typename visitor_t>
+inline size_t R_class_area::nearest(const point_t& point, size_t k, visitor_t&& visitor) const
+{
+	/*элемент очереди: узел (index == npos) или объект index листа v*/
+	struct item_t
+	{
+		distance_t dist;
+		const node* v;
+		size_t index;
+		bool operator>(const item_t& other) const { return this->dist > other.dist; }
+	};
+	constexpr size_t npos{ std::numeric_limits<size_t>::max() };
+
+	typename stats_policy::scope scope{};
+	size_t count_found{};
+	if (k == 0 || !this->root->count_array)
+		return count_found;
+
+	std::priority_queue<item_t, std::vector<item_t>, std::greater<item_t>> queue{};
+	queue.push(item_t{ this->template min_dist<distance_t>(point, this->root->mbr), this->root, npos });
+	while (!queue.empty())
+	{
+		item_t top{ queue.top() };
+		queue.pop();
+
+		if (top.index != npos) /*объект ближе всех оставшихся узлов и объектов*/
+		{
+			count_hits(1);
+			count_found++;
+			if (!visitor(top.v->object(top.index), std::sqrt(top.dist)) || count_found == k)
+				break;
+			continue;
+		}
+
+		count_visit(top.v->count_array);
+		for (size_t i = 0; i < top.v->count_array; i++)
+		{
+			distance_t dist{ this->template min_dist<distance_t>(point, top.v->get_mbr(i)) };
+			if (top.v->leaf)
+				queue.push(item_t{ dist, top.v, i });
+			else
+				queue.push(item_t{ dist, top.v->child(i), npos });
+		}
+	}
+	return count_found;
+}
+
+R_template
+template<typename visitor_t>
+inline void R_class_area::search_batch(mbr_test test, const std::vector<mbr_t>& windows, visitor_t&& visitor) const
 {
-	return this->search(true, mbr, callback, context);
+	typename stats_policy::scope scope{};
+	if (windows.empty() || !this->root->count_array)
+		return;
+
+	std::vector<std::vector<size_t>> queries(this->height + 1);
+	std::vector<std::vector<uint64_t>> masks(this->height);
+	for (size_t q : hilbert_order<num_dims>(windows.size(), [&windows](size_t i) -> const mbr_t& { return windows[i]; }))
+	{
+		if (this->test_mbr(mbr_node_test(test), this->root->mbr, windows[q]))
+			queries[0].push_back(q);
+	}
+	if (queries[0].empty())
+		return;
+
+	mbr_dispatch(test, [&](auto t)
+		{
+			return this->template search_batch<decltype(t)::value>(this->root, 0, windows, queries, masks, visitor);
+		});
 }
 
 R_template
-inline size_t R_class_area::search_objects(const mbr_t& mbr, const callback_t& callback, void* context)
+template<mbr_test test, typename visitor_t>
+inline bool R_class_area::search_batch(const node* v, size_t depth, const std::vector<mbr_t>& windows,
+	std::vector<std::vector<size_t>>& queries, std::vector<std::vector<uint64_t>>& masks, visitor_t& visitor) const
 {
-	return this->search(false, mbr, callback, context);
+	const std::vector<size_t>& active{ queries[depth] };
+	std::vector<uint64_t>& mask{ masks[depth] };
+	mask.resize(active.size());
+	count_visit(v->count_array * active.size());
+
+	uint64_t any{};
+	for (size_t j = 0; j < active.size(); j++) /*записи узла, нужные хотя бы одному запросу*/
+	{
+		mask[j] = v->leaf ? v->template match<test>(windows[active[j]]) : v->template match<mbr_node_test(test)>(windows[active[j]]);
+		any |= mask[j];
+	}
+
+	std::vector<size_t>& sub{ queries[depth + 1] };
+	while (any)
+	{
+		size_t i{ mbr_first_bit(any) };
+		any &= any - 1;
+
+		sub.clear();
+		for (size_t j = 0; j < active.size(); j++)
+		{
+			if (mask[j] & (uint64_t(1) << i))
+				sub.push_back(active[j]);
+		}
+
+		if (v->leaf)
+		{
+			count_hits(1);
+			if (!visitor(v->object(i), static_cast<const std::vector<size_t>&>(sub)))
+				return false;
+		}
+		else if (!this->template search_batch<test>(v->child(i), depth + 1, windows, queries, masks, visitor))
+		{
+			return false;
+		}
+	}
+	return true;
 }
 
 R_template
 inline size_t R_class_area::size(const size_callback_t& handler) const
 {
-	size_t total{ sizeof(R_tree) };
+	size_t total{ sizeof(R_tree) + this->pool.bytes() }; /*память узлов считается по блокам пула*/
 
 	if (this->root)
 	{
@@ -1026,21 +2064,44 @@ inline size_t R_class_area::size(const size_callback_t& handler) const
 R_template
 inline void R_class_area::size(size_t& total, const node_ptr_t& v, const size_callback_t& handler) const
 {
-	total += sizeof(node);
-
 	if (!v->leaf) /*если не листок*/
 	{
 		for (size_t i = 0; i < v->count_array; i++)
 		{
-			this->size(total, std::get<child_array_ptr_t>(v->data)[i].child, handler);
+			this->size(total, v->child(i), handler);
 		}
 	}
 	else
 	{
 		for (size_t i = 0; i < v->count_array; i++)
 		{
-			const data_type& id{ std::get<data_array_t>(v->data)[i].data };
+			const data_type& id{ v->object(i) };
 			total += handler(id);
 		}
 	}
 }
+
+R_template
+inline size_t R_class_area::count_visits(mbr_test test, const mbr_t& mbr) const
+{
+	if (!this->root->count_array || !this->test_mbr(mbr_node_test(test), this->root->mbr, mbr))
+		return 0u;
+	return this->count_visits(test, this->root, mbr);
+}
+
+R_template
+inline size_t R_class_area::count_visits(mbr_test test, const node* v, const mbr_t& mbr) const
+{
+	size_t visits{ 1 };
+	if (!v->leaf)
+	{
+		uint64_t hits{ v->match(mbr_node_test(test), mbr) };
+		while (hits)
+		{
+			size_t i{ mbr_first_bit(hits) };
+			hits &= hits - 1;
+			visits += this->count_visits(test, v->child(i), mbr);
+		}
+	}
+	return visits;
+}
@@ -0,0 +1,335 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#include "mbr_kernel.hpp"
+#include "mapped_file.hpp"
+
+/*
+Образ r-дерева без указателей (R_tree::write_image): все ссылки - смещения от начала раздела узлов
+-заголовок frozen_header
+-узлы в порядке обхода в ширину, каждый узел - одна непрерывная запись (frozen_record_size):
+ mbr ровно count записей по измерениям: ld[d][0..count), затем ru[d][0..count),
+ затем у листа - count объектов, у внутреннего узла - count ссылок frozen_node на потомков;
+ в конце раздела запас frozen_box_tail координат для векторного чтения строк последнего узла
+Ссылка на узел (у корня - в заголовке) хранит число его записей, поэтому адреса строк mbr узла известны
+до чтения самой записи, и чтение строк не ждет загрузки счетчика.
+Записи выровнены по 8 байт, порядок байт - порядок машины, на которой записан образ.
+Образ можно сохранить в файл и открыть через отображение в память: поиск идет прямо по отображению, без разбора
+*/
+
+/*ссылка на запись узла образа*/
+struct frozen_node
+{
+	/*число записей*/
+	uint32_t count;
+	uint32_t leaf;
+	/*смещение записи от начала раздела узлов*/
+	uint64_t offset;
+};
+
+/*заголовок образа*/
+struct frozen_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_dims;
+	uint32_t coord_size;
+	uint32_t data_size;
+	uint32_t height;
+	uint64_t node_count;
+	uint64_t object_count;
+	/*ссылка на корень*/
+	frozen_node root;
+	/*смещение раздела узлов от начала заголовка*/
+	uint64_t nodes;
+	/*размер образа*/
+	uint64_t bytes;
+};
+
+constexpr uint32_t frozen_magic{ 0x46525452 }; /*"RTRF"*/
+constexpr uint32_t frozen_version{ 2 };
+constexpr size_t frozen_box_tail{ 8 };
+
+/*смещение, выровненное по 8 байт*/
+constexpr size_t frozen_align(size_t offset)
+{
+	return (offset + 7) / 8 * 8;
+}
+
+/*смещение объектов или ссылок на потомков от начала записи узла с count записями*/
+constexpr size_t frozen_entries_offset(size_t count, size_t num_dims, size_t coord_size)
+{
+	return frozen_align(2 * num_dims * count * coord_size);
+}
+
+/*размер записи узла с count записями; entry_size - размер объекта у листа*/
+constexpr size_t frozen_record_size(size_t count, bool leaf, size_t num_dims, size_t coord_size, size_t entry_size)
+{
+	return frozen_align(frozen_entries_offset(count, num_dims, coord_size) + count * (leaf ? entry_size : sizeof(frozen_node)));
+}
+
+
+#define R_frozen_template   template<typename data_type, typename coord_type, size_t num_dims, typename float_type>
+#define R_frozen_class_area Frozen_R_tree<data_type, coord_type, num_dims, float_type>
+
+
+/*
+замороженное r-дерево: поиск только для чтения по образу, записанному R_tree::write_image
+узлы занимают один непрерывный массив без указателей, у каждого узла ровно count записей;
+data_type - тип объектов образа (результат функции преобразования при записи).
+Дерево, построенное по адресу образа, его не копирует: память образа должна жить, пока идет поиск;
+дерево из open() или R_tree::freeze само владеет отображением или буфером, копии дерева разделяют один образ.
+Все функции константные, их можно вызывать одновременно из нескольких потоков
+*/
+template<
+	typename data_type,
+	typename coord_type,
+	size_t num_dims,
+	typename float_type>
+class Frozen_R_tree
+{
+public:
+	using point_t = std::array<coord_type, num_dims>;
+	using callback_t = std::function<bool(data_type, void*)>;
+	/*левая нижн. точка и правая верхн. точка mbr*/
+	struct mbr_t
+	{
+		point_t ld;
+		point_t ru;
+	};
+
+	Frozen_R_tree() = default;
+	/*дерево по образу с адреса image (заголовок), bytes - сколько байт доступно с этого адреса*/
+	Frozen_R_tree(const char* image, size_t bytes);
+	/*дерево, владеющее образом в памяти (R_tree::freeze)*/
+	explicit Frozen_R_tree(std::vector<char> image);
+
+	/*открытие файла образа через отображение в память, offset - смещение образа в файле*/
+	bool open(const char* path, size_t offset = 0);
+
+	/*образ прочитан и подходит по типам*/
+	bool valid() const;
+
+	/*поиск объектов, mbr которых удовлетворяет проверке test с окном mbr (как R_tree::search)*/
+	size_t search(mbr_test test, const mbr_t& mbr, const callback_t& callback, void* context) const;
+	template<typename visitor_t>
+	size_t search(mbr_test test, const mbr_t& mbr, visitor_t&& visitor) const;
+
+	size_t search_in_range(const mbr_t& mbr, const callback_t& callback, void* context) const;
+	template<typename visitor_t>
+	size_t search_in_range(const mbr_t& mbr, visitor_t&& visitor) const;
+
+	size_t search_objects(const mbr_t& mbr, const callback_t& callback, void* context) const;
+	template<typename visitor_t>
+	size_t search_objects(const mbr_t& mbr, visitor_t&& visitor) const;
+
+	size_t search_intersecting(const mbr_t& mbr, const callback_t& callback, void* context) const;
+	template<typename visitor_t>
+	size_t search_intersecting(const mbr_t& mbr, visitor_t&& visitor) const;
+
+	/*число объектов*/
+	size_t count() const;
+
+	/*размер образа в байтах*/
+	size_t size() const;
+
+private:
+	/*владелец памяти образа (отображенный файл или буфер), пуст, если образ чужой*/
+	std::shared_ptr<const void> storage{};
+	const frozen_header* header{ nullptr };
+	const char* nodes{ nullptr };
+
+	/*проверка заголовка и настройка разделов*/
+	bool attach(const char* image, size_t bytes);
+
+	/*маска записей узла v, удовлетворяющих проверке test с окном mbr*/
+	template<mbr_test test>
+	uint64_t match(const frozen_node& v, const mbr_t& mbr) const;
+
+	/*поиск объектов, удовлетворяющих проверке test, в узле v*/
+	template<mbr_test test, typename visitor_t>
+	bool search(frozen_node v, const mbr_t& mbr, size_t& count_found, visitor_t& visitor) const;
+};
+
+R_frozen_template
+inline R_frozen_class_area::Frozen_R_tree(const char* image, size_t bytes)
+{
+	this->attach(image, bytes);
+}
+
+R_frozen_template
+inline R_frozen_class_area::Frozen_R_tree(std::vector<char> image)
+{
+	std::shared_ptr<std::vector<char>> buffer{ std::make_shared<std::vector<char>>(std::move(image)) };
+	if (this->attach(buffer->data(), buffer->size()))
+		this->storage = std::move(buffer);
+}
+
+R_frozen_template
+inline bool R_frozen_class_area::open(const char* path, size_t offset)
+{
+	std::shared_ptr<Mapped_file> file{ std::make_shared<Mapped_file>() };
+	if (!file->open(path) || offset >= file->size() || !this->attach(file->data() + offset, file->size() - offset))
+	{
+		this->attach(nullptr, 0);
+		return false;
+	}
+	this->storage = std::move(file);
+	return true;
+}
+
+R_frozen_template
+inline bool R_frozen_class_area::attach(const char* image, size_t bytes)
+{
+	static_assert(std::is_trivially_copyable_v<data_type>, "объекты образа хранятся побайтно");
+
+	this->storage.reset();
+	this->header = nullptr;
+	this->nodes = nullptr;
+	if (image == nullptr || bytes < sizeof(frozen_header))
+		return false;
+
+	const frozen_header* h{ reinterpret_cast<const frozen_header*>(image) };
+	if (h->magic != frozen_magic || h->version != frozen_version || h->num_dims != num_dims
+		|| h->coord_size != sizeof(coord_type) || h->data_size != sizeof(data_type) || h->bytes > bytes || h->node_count == 0)
+		return false;
+
+	this->header = h;
+	this->nodes = image + h->nodes;
+	return true;
+}
+
+R_frozen_template
+inline bool R_frozen_class_area::valid() const
+{
+	return this->header != nullptr;
+}
+
+R_frozen_template
+inline size_t R_frozen_class_area::count() const
+{
+	return this->header ? size_t(this->header->object_count) : 0u;
+}
+
+R_frozen_template
+inline size_t R_frozen_class_area::size() const
+{
+	return this->header ? size_t(this->header->bytes) : 0u;
+}
+
+R_frozen_template
+template<mbr_test test>
+inline uint64_t R_frozen_class_area::match(const frozen_node& v, const mbr_t& mbr) const
+{
+	const size_t count{ v.count };
+	const coord_type* box{ reinterpret_cast<const coord_type*>(this->nodes + v.offset) };
+	return mbr_kernel<coord_type, num_dims, 64>::template mask_rows<test>(box, box + num_dims * count, count, count, mbr.ld, mbr.ru);
+}
+
+R_frozen_template
+inline size_t R_frozen_class_area::search(mbr_test test, const mbr_t& mbr, const callback_t& callback, void* context) const
+{
+	return this->search(test, mbr, [&callback, context](const data_type& id) { return callback(id, context); });
+}
+
+R_frozen_template
+template<typename visitor_t>
+inline size_t R_frozen_class_area::search(mbr_test test, const mbr_t& mbr, visitor_t&& visitor) const
+{
+	size_t count_founded{};
+
+	if (this->header && this->header->root.count)
+	{
+		mbr_dispatch(test, [&](auto t)
+			{
+				return this->template search<decltype(t)::value>(this->header->root, mbr, count_founded, visitor);
+			});
+	}
+	return count_founded;
+}
+
+R_frozen_template
+template<mbr_test test, typename visitor_t>
+inline bool R_frozen_class_area::search(frozen_node v, const mbr_t& mbr, size_t& count_found, visitor_t& visitor) const
+{
+	const char* entries{ this->nodes + v.offset + frozen_entries_offset(v.count, num_dims, sizeof(coord_type)) };
+	if (!v.leaf)
+	{
+		const frozen_node* children{ reinterpret_cast<const frozen_node*>(entries) };
+		uint64_t hits{ this->template match<mbr_node_test(test)>(v, mbr) }; /*во внутренних узлах - проверка поддеревьев*/
+		while (hits)
+		{
+			size_t i{ mbr_first_bit(hits) };
+			hits &= hits - 1;
+			if (!this->template search<test>(children[i], mbr, count_found, visitor))
+			{
+				return false;
+			}
+		}
+	}
+	else
+	{
+		const data_type* objects{ reinterpret_cast<const data_type*>(entries) };
+		uint64_t hits{ this->template match<test>(v, mbr) };
+		while (hits)
+		{
+			size_t i{ mbr_first_bit(hits) };
+			hits &= hits - 1;
+			count_found++;
+
+			if (!visitor(objects[i]))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+R_frozen_template
+inline size_t R_frozen_class_area::search_in_range(const mbr_t& mbr, const callback_t& callback, void* context) const
+{
+	return this->search(mbr_test::inside, mbr, callback, context);
+}
+
+R_frozen_template
+template<typename visitor_t>
+inline size_t R_frozen_class_area::search_in_range(const mbr_t& mbr, visitor_t&& visitor) const
+{
+	return this->search(mbr_test::inside, mbr, std::forward<visitor_t>(visitor));
+}
+
+R_frozen_template
+inline size_t R_frozen_class_area::search_objects(const mbr_t& mbr, const callback_t& callback, void* context) const
+{
+	return this->search(mbr_test::covers, mbr, callback, context);
+}
+
+R_frozen_template
+template<typename visitor_t>
+inline size_t R_frozen_class_area::search_objects(const mbr_t& mbr, visitor_t&& visitor) const
+{
+	return this->search(mbr_test::covers, mbr, std::forward<visitor_t>(visitor));
+}
+
+R_frozen_template
+inline size_t R_frozen_class_area::search_intersecting(const mbr_t& mbr, const callback_t& callback, void* context) const
+{
+	return this->search(mbr_test::intersects, mbr, callback, context);
+}
+
+R_frozen_template
+template<typename visitor_t>
+inline size_t R_frozen_class_area::search_intersecting(const mbr_t& mbr, visitor_t&& visitor) const
+{
+	return this->search(mbr_test::intersects, mbr, std::forward<visitor_t>(visitor));
+}
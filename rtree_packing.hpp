@@ -0,0 +1,129 @@
+#pragma once
+
+#include "hilbert.hpp"
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <limits>
+#include <utility>
+
+/*
+Политики пакетной загрузки R_tree::bulk_load
+Политика задает порядок записей уровня перед укладкой в узлы по max_nodes подряд:
+template<size_t max_nodes, typename info_t> static void order(std::vector<info_t>& q, bool leaf_level);
+info_t - запись с полем mbr (ld, ru)
+*/
+
+/*Sort-Tile-Recursive (Leutenegger, 1997): полосы по каждому измерению, каждый уровень упорядочивается заново*/
+struct R_str_packing
+{
+	template<size_t max_nodes, typename info_t>
+	static void order(std::vector<info_t>& q, bool /*leaf_level*/)
+	{
+		sort(q, 0, q.size(), 0, max_nodes);
+	}
+
+private:
+	template<typename info_t>
+	static void sort(std::vector<info_t>& q, size_t first, size_t last, size_t dim, size_t max_nodes)
+	{
+		constexpr size_t num_dims{ std::tuple_size<std::remove_reference_t<decltype(std::declval<info_t&>().mbr.ld)>>::value };
+
+		size_t n{ last - first };
+		if (n <= max_nodes)
+			return;
+
+		std::sort(q.begin() + first, q.begin() + last, [dim](const info_t& a, const info_t& b)
+			{
+				return double(a.mbr.ld[dim]) + double(a.mbr.ru[dim]) < double(b.mbr.ld[dim]) + double(b.mbr.ru[dim]); /*по центру mbr*/
+			});
+		if (dim + 1 == num_dims)
+			return;
+
+		/*делим на slabs полос, каждая - целое число узлов, полосы упорядочиваются по следующему измерению*/
+		size_t pages{ (n + max_nodes - 1) / max_nodes };
+		size_t slabs{ size_t(std::ceil(std::pow(double(pages), 1.0 / double(num_dims - dim)))) };
+		size_t slab_size{ (pages + slabs - 1) / slabs * max_nodes };
+		for (size_t begin = first; begin < last; begin += slab_size)
+		{
+			sort(q, begin, std::min(last, begin + slab_size), dim + 1, max_nodes);
+		}
+	}
+};
+
+/*
+порядок записей по ключу Гильберта центров их mbr (get_mbr(i) - mbr i-й записи),
+центры нормируются по общим границам; при равных ключах сохраняется исходный порядок
+*/
+template<size_t num_dims, typename get_mbr_t>
+inline std::vector<size_t> hilbert_order(size_t count, const get_mbr_t& get_mbr)
+{
+	constexpr uint32_t bits{ hilbert_bits<num_dims>() };
+
+	/*границы центров по каждому измерению*/
+	std::array<double, num_dims> lo{}, hi{};
+	lo.fill(std::numeric_limits<double>::max());
+	hi.fill(std::numeric_limits<double>::lowest());
+	for (size_t i = 0; i < count; i++)
+	{
+		for (size_t d = 0; d < num_dims; d++)
+		{
+			double c{ (double(get_mbr(i).ld[d]) + double(get_mbr(i).ru[d])) / 2 };
+			lo[d] = std::min(lo[d], c);
+			hi[d] = std::max(hi[d], c);
+		}
+	}
+
+	const double cells{ double((uint64_t(1) << bits) - 1) };
+	std::vector<std::pair<uint64_t, size_t>> keys{};
+	keys.reserve(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		std::array<uint32_t, num_dims> cell{};
+		for (size_t d = 0; d < num_dims; d++)
+		{
+			double c{ (double(get_mbr(i).ld[d]) + double(get_mbr(i).ru[d])) / 2 };
+			cell[d] = hi[d] > lo[d] ? uint32_t((c - lo[d]) / (hi[d] - lo[d]) * cells) : 0u;
+		}
+		keys.push_back({ hilbert_index<num_dims>(cell, bits), i });
+	}
+	std::sort(keys.begin(), keys.end()); /*пара (индекс, позиция) - порядок устойчивый*/
+
+	std::vector<size_t> order{};
+	order.reserve(count);
+	for (const std::pair<uint64_t, size_t>& key : keys)
+	{
+		order.push_back(key.second);
+	}
+	return order;
+}
+
+/*
+Упаковка по кривой Гильберта (Kamel, Faloutsos, 1993): листовые записи сортируются по индексу Гильберта
+центра mbr, верхние уровни укладываются в том же порядке. Порядок устойчивый: при равных индексах
+сохраняется исходный порядок записей
+*/
+struct R_hilbert_packing
+{
+	template<size_t max_nodes, typename info_t>
+	static void order(std::vector<info_t>& q, bool leaf_level)
+	{
+		constexpr size_t num_dims{ std::tuple_size<std::remove_reference_t<decltype(std::declval<info_t&>().mbr.ld)>>::value };
+
+		if (!leaf_level || q.size() <= max_nodes)
+			return;
+
+		std::vector<size_t> keys{ hilbert_order<num_dims>(q.size(), [&q](size_t i) -> const auto& { return q[i].mbr; }) };
+
+		std::vector<info_t> sorted{};
+		sorted.reserve(q.size());
+		for (size_t key : keys)
+		{
+			sorted.push_back(std::move(q[key]));
+		}
+		q = std::move(sorted);
+	}
+};
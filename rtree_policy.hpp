@@ -0,0 +1,513 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+/*
+Политики вставки R_tree: выбор поддерева при спуске и деление переполненного узла
+Интерфейс политики:
+-static constexpr bool forced_reinsert - выполнять ли повторную вставку при переполнении (R*)
+-template<typename float_type, typename mbr_source_t, typename mbr_t>
+ static size_t choose_subtree(const mbr_source_t& entry_mbr, size_t count, const mbr_t& mbr, bool leaf_children);
+ entry_mbr(i) - mbr i-й записи узла, leaf_children - потомки узла являются листами
+-template<size_t min_nodes, typename float_type, typename info_t, size_t n>
+ static size_t split(std::array<info_t, n>& entries);
+ переставляет записи: [0, k) уходят в первый узел, [k, n) - во второй, возвращает k
+-template<size_t max_nodes, typename float_type, typename info_t, size_t n>
+ static size_t reinsert_split(std::array<info_t, n>& entries); (только при forced_reinsert)
+ записи [k, n) удаляются из узла и вставляются заново в этом порядке, возвращает k
+Площади и периметры считаются в float_type, который передает дерево (R_tree::metric_t - не уже coord_type и не уже double),
+чтобы не переполнять целые координаты и не терять разницу близких кандидатов
+*/
+
+/*функции для работы с mbr в политиках*/
+template<typename mbr_t>
+constexpr size_t mbr_dims_v{ std::tuple_size<decltype(mbr_t::ld)>::value };
+
+template<typename mbr_t>
+inline mbr_t mbr_union(const mbr_t& m1, const mbr_t& m2)
+{
+	mbr_t m{};
+	for (size_t i = 0; i < mbr_dims_v<mbr_t>; i++)
+	{
+		m.ld[i] = std::min(m1.ld[i], m2.ld[i]);
+		m.ru[i] = std::max(m1.ru[i], m2.ru[i]);
+	}
+	return m;
+}
+
+template<typename float_type, typename mbr_t>
+inline float_type mbr_area(const mbr_t& m)
+{
+	float_type area{ 1 };
+	for (size_t i = 0; i < mbr_dims_v<mbr_t>; i++)
+	{
+		area *= float_type(m.ru[i]) - float_type(m.ld[i]);
+	}
+	return area;
+}
+
+/*полупериметр*/
+template<typename float_type, typename mbr_t>
+inline float_type mbr_margin(const mbr_t& m)
+{
+	float_type margin{};
+	for (size_t i = 0; i < mbr_dims_v<mbr_t>; i++)
+	{
+		margin += float_type(m.ru[i]) - float_type(m.ld[i]);
+	}
+	return margin;
+}
+
+/*площадь пересечения*/
+template<typename float_type, typename mbr_t>
+inline float_type mbr_overlap(const mbr_t& m1, const mbr_t& m2)
+{
+	float_type area{ 1 };
+	for (size_t i = 0; i < mbr_dims_v<mbr_t>; i++)
+	{
+		float_type lo{ float_type(std::max(m1.ld[i], m2.ld[i])) };
+		float_type hi{ float_type(std::min(m1.ru[i], m2.ru[i])) };
+		if (hi < lo)
+			return 0;
+		area *= hi - lo;
+	}
+	return area;
+}
+
+/*перестановка записей по группам: сначала группа 1, затем остальные; возвращает размер группы 1*/
+template<typename info_t, size_t n>
+inline size_t r_partition(std::array<info_t, n>& entries, const std::array<unsigned char, n>& group)
+{
+	std::array<info_t, n> sorted{};
+	size_t k{};
+	for (size_t i = 0; i < n; i++)
+	{
+		if (group[i] == 1)
+			sorted[k++] = std::move(entries[i]);
+	}
+	size_t j{ k };
+	for (size_t i = 0; i < n; i++)
+	{
+		if (group[i] != 1)
+			sorted[j++] = std::move(entries[i]);
+	}
+	entries = std::move(sorted);
+	return k;
+}
+
+/*выбор записи с наименьшим приростом площади, при равенстве - с наименьшей площадью*/
+template<typename float_type, typename mbr_source_t, typename mbr_t>
+inline size_t r_least_enlargement(const mbr_source_t& entry_mbr, size_t count, const mbr_t& mbr)
+{
+	size_t best{};
+	float_type best_growth{ std::numeric_limits<float_type>::max() };
+	float_type best_area{ std::numeric_limits<float_type>::max() };
+	for (size_t i = 0; i < count; i++)
+	{
+		mbr_t m{ entry_mbr(i) };
+		float_type area{ mbr_area<float_type>(m) };
+		float_type growth{ mbr_area<float_type>(mbr_union(m, mbr)) - area };
+		if (growth < best_growth || (growth == best_growth && area < best_area))
+		{
+			best = i;
+			best_growth = growth;
+			best_area = area;
+		}
+	}
+	return best;
+}
+
+/*Гуттман (1984): наименьший прирост площади и квадратичное деление*/
+struct R_quadratic_policy
+{
+	static constexpr bool forced_reinsert{ false };
+
+	template<typename float_type, typename mbr_source_t, typename mbr_t>
+	static size_t choose_subtree(const mbr_source_t& entry_mbr, size_t count, const mbr_t& mbr, bool /*leaf_children*/)
+	{
+		return r_least_enlargement<float_type>(entry_mbr, count, mbr);
+	}
+
+	template<size_t min_nodes, typename float_type, typename info_t, size_t n>
+	static size_t split(std::array<info_t, n>& entries)
+	{
+		using mbr_t = decltype(info_t::mbr);
+
+		/*первая пара: больше всего пустого места при объединении*/
+		size_t s1{ 0 }, s2{ 1 };
+		float_type worst{ std::numeric_limits<float_type>::lowest() };
+		for (size_t i = 0; i < n; i++)
+		{
+			for (size_t j = i + 1; j < n; j++)
+			{
+				float_type waste{ mbr_area<float_type>(mbr_union(entries[i].mbr, entries[j].mbr)) - mbr_area<float_type>(entries[i].mbr) - mbr_area<float_type>(entries[j].mbr) };
+				if (waste > worst)
+				{
+					worst = waste;
+					s1 = i;
+					s2 = j;
+				}
+			}
+		}
+
+		std::array<unsigned char, n> group{};
+		group[s1] = 1;
+		group[s2] = 2;
+		mbr_t m1{ entries[s1].mbr }, m2{ entries[s2].mbr };
+		size_t n1{ 1 }, n2{ 1 }, left{ n - 2 };
+
+		while (left > 0)
+		{
+			if (n1 + left <= min_nodes || n2 + left <= min_nodes) /*оставшиеся нужны группе для минимального заполнения*/
+			{
+				unsigned char g{ n1 + left <= min_nodes ? (unsigned char)1 : (unsigned char)2 };
+				for (size_t i = 0; i < n; i++)
+				{
+					if (!group[i])
+						group[i] = g;
+				}
+				break;
+			}
+
+			/*следующая запись: наибольшая разница приростов площадей групп*/
+			size_t next{};
+			float_type best_diff{ -1 }, d1{}, d2{};
+			for (size_t i = 0; i < n; i++)
+			{
+				if (group[i])
+					continue;
+				float_type g1{ mbr_area<float_type>(mbr_union(m1, entries[i].mbr)) - mbr_area<float_type>(m1) };
+				float_type g2{ mbr_area<float_type>(mbr_union(m2, entries[i].mbr)) - mbr_area<float_type>(m2) };
+				float_type diff{ std::abs(g1 - g2) };
+				if (diff > best_diff)
+				{
+					best_diff = diff;
+					next = i;
+					d1 = g1;
+					d2 = g2;
+				}
+			}
+
+			bool first{ d1 < d2 || (d1 == d2 && (mbr_area<float_type>(m1) < mbr_area<float_type>(m2) || (mbr_area<float_type>(m1) == mbr_area<float_type>(m2) && n1 <= n2))) };
+			if (first)
+			{
+				group[next] = 1;
+				m1 = mbr_union(m1, entries[next].mbr);
+				n1++;
+			}
+			else
+			{
+				group[next] = 2;
+				m2 = mbr_union(m2, entries[next].mbr);
+				n2++;
+			}
+			left--;
+		}
+
+		return r_partition(entries, group);
+	}
+};
+
+/*
+R*-дерево (Beckmann и др., 1990): выбор поддерева по наименьшему приросту перекрытия на уровне над листьями,
+деление по оси с наименьшей суммой периметров, повторная вставка 30% дальних записей при первом переполнении уровня
+*/
+struct R_rstar_policy
+{
+	static constexpr bool forced_reinsert{ true };
+
+	template<typename float_type, typename mbr_source_t, typename mbr_t>
+	static size_t choose_subtree(const mbr_source_t& entry_mbr, size_t count, const mbr_t& mbr, bool leaf_children)
+	{
+		if (!leaf_children)
+			return r_least_enlargement<float_type>(entry_mbr, count, mbr);
+
+		size_t best{};
+		float_type best_overlap{ std::numeric_limits<float_type>::max() };
+		float_type best_growth{ std::numeric_limits<float_type>::max() };
+		float_type best_area{ std::numeric_limits<float_type>::max() };
+		for (size_t i = 0; i < count; i++)
+		{
+			mbr_t m{ entry_mbr(i) };
+			mbr_t grown{ mbr_union(m, mbr) };
+			float_type overlap{};
+			for (size_t j = 0; j < count; j++)
+			{
+				if (j == i)
+					continue;
+				mbr_t other{ entry_mbr(j) };
+				overlap += mbr_overlap<float_type>(grown, other) - mbr_overlap<float_type>(m, other);
+			}
+			float_type area{ mbr_area<float_type>(m) };
+			float_type growth{ mbr_area<float_type>(grown) - area };
+			if (overlap < best_overlap
+				|| (overlap == best_overlap && (growth < best_growth || (growth == best_growth && area < best_area))))
+			{
+				best = i;
+				best_overlap = overlap;
+				best_growth = growth;
+				best_area = area;
+			}
+		}
+		return best;
+	}
+
+	template<size_t min_nodes, typename float_type, typename info_t, size_t n>
+	static size_t split(std::array<info_t, n>& entries)
+	{
+		using mbr_t = decltype(info_t::mbr);
+		constexpr size_t num_dims{ mbr_dims_v<mbr_t> };
+		constexpr size_t first_k{ min_nodes > 0 ? min_nodes : 1 };
+		constexpr size_t last_k{ n - first_k };
+
+		/*mbr префиксов и суффиксов отсортированных записей*/
+		std::array<mbr_t, n> prefix{}, suffix{};
+		auto bounds = [&]()
+		{
+			prefix[0] = entries[0].mbr;
+			for (size_t i = 1; i < n; i++)
+				prefix[i] = mbr_union(prefix[i - 1], entries[i].mbr);
+			suffix[n - 1] = entries[n - 1].mbr;
+			for (size_t i = n - 1; i-- > 0;)
+				suffix[i] = mbr_union(suffix[i + 1], entries[i].mbr);
+		};
+
+		/*ось: наименьшая сумма периметров по всем распределениям*/
+		size_t axis{};
+		float_type best_margin{ std::numeric_limits<float_type>::max() };
+		for (size_t d = 0; d < num_dims; d++)
+		{
+			float_type margin{};
+			for (bool by_upper : { false, true })
+			{
+				sort_axis(entries, d, by_upper);
+				bounds();
+				for (size_t k = first_k; k <= last_k; k++)
+				{
+					margin += mbr_margin<float_type>(prefix[k - 1]) + mbr_margin<float_type>(suffix[k]);
+				}
+			}
+			if (margin < best_margin)
+			{
+				best_margin = margin;
+				axis = d;
+			}
+		}
+
+		/*распределение: наименьшее перекрытие, затем наименьшая площадь*/
+		bool best_upper{ false };
+		size_t best_k{ first_k };
+		float_type best_overlap{ std::numeric_limits<float_type>::max() };
+		float_type best_area{ std::numeric_limits<float_type>::max() };
+		for (bool by_upper : { false, true })
+		{
+			sort_axis(entries, axis, by_upper);
+			bounds();
+			for (size_t k = first_k; k <= last_k; k++)
+			{
+				float_type overlap{ mbr_overlap<float_type>(prefix[k - 1], suffix[k]) };
+				float_type area{ mbr_area<float_type>(prefix[k - 1]) + mbr_area<float_type>(suffix[k]) };
+				if (overlap < best_overlap || (overlap == best_overlap && area < best_area))
+				{
+					best_overlap = overlap;
+					best_area = area;
+					best_upper = by_upper;
+					best_k = k;
+				}
+			}
+		}
+		sort_axis(entries, axis, best_upper);
+		return best_k;
+	}
+
+	template<size_t max_nodes, typename float_type, typename info_t, size_t n>
+	static size_t reinsert_split(std::array<info_t, n>& entries)
+	{
+		using mbr_t = decltype(info_t::mbr);
+		constexpr size_t num_dims{ mbr_dims_v<mbr_t> };
+		constexpr size_t p{ max_nodes * 3 / 10 > 0 ? max_nodes * 3 / 10 : 1 };
+
+		mbr_t all{ entries[0].mbr };
+		for (size_t i = 1; i < n; i++)
+			all = mbr_union(all, entries[i].mbr);
+
+		/*по возрастанию расстояния от центра узла: дальние p записей в конце, вставляются от ближней к дальней*/
+		auto distance = [&all](const mbr_t& m)
+		{
+			float_type dist{};
+			for (size_t d = 0; d < num_dims; d++)
+			{
+				float_type delta{ (float_type(m.ld[d]) + float_type(m.ru[d])) / 2 - (float_type(all.ld[d]) + float_type(all.ru[d])) / 2 };
+				dist += delta * delta;
+			}
+			return dist;
+		};
+		std::sort(entries.begin(), entries.end(), [&distance](const info_t& a, const info_t& b)
+			{
+				return distance(a.mbr) < distance(b.mbr);
+			});
+		return n - p;
+	}
+
+private:
+	template<typename info_t, size_t n>
+	static void sort_axis(std::array<info_t, n>& entries, size_t axis, bool by_upper)
+	{
+		std::sort(entries.begin(), entries.end(), [axis, by_upper](const info_t& a, const info_t& b)
+			{
+				if (by_upper)
+					return a.mbr.ru[axis] < b.mbr.ru[axis] || (a.mbr.ru[axis] == b.mbr.ru[axis] && a.mbr.ld[axis] < b.mbr.ld[axis]);
+				return a.mbr.ld[axis] < b.mbr.ld[axis] || (a.mbr.ld[axis] == b.mbr.ld[axis] && a.mbr.ru[axis] < b.mbr.ru[axis]);
+			});
+	}
+};
+
+/*
+Гуттман (1984): линейное деление - первая пара по наибольшему нормированному разносу по одной из осей,
+остальные записи за один проход уходят в группу с наименьшим приростом площади
+*/
+struct R_linear_policy
+{
+	static constexpr bool forced_reinsert{ false };
+
+	template<typename float_type, typename mbr_source_t, typename mbr_t>
+	static size_t choose_subtree(const mbr_source_t& entry_mbr, size_t count, const mbr_t& mbr, bool /*leaf_children*/)
+	{
+		return r_least_enlargement<float_type>(entry_mbr, count, mbr);
+	}
+
+	template<size_t min_nodes, typename float_type, typename info_t, size_t n>
+	static size_t split(std::array<info_t, n>& entries)
+	{
+		using mbr_t = decltype(info_t::mbr);
+		constexpr size_t num_dims{ mbr_dims_v<mbr_t> };
+
+		/*первая пара: запись с наибольшей нижней границей и запись с наименьшей верхней*/
+		size_t s1{ 0 }, s2{ 1 };
+		float_type best_separation{ std::numeric_limits<float_type>::lowest() };
+		for (size_t d = 0; d < num_dims; d++)
+		{
+			size_t high_ld{ 0 }, low_ru{ 0 };
+			float_type min_ld{ float_type(entries[0].mbr.ld[d]) }, max_ru{ float_type(entries[0].mbr.ru[d]) };
+			for (size_t i = 1; i < n; i++)
+			{
+				if (entries[i].mbr.ld[d] > entries[high_ld].mbr.ld[d])
+					high_ld = i;
+				if (entries[i].mbr.ru[d] < entries[low_ru].mbr.ru[d])
+					low_ru = i;
+				min_ld = std::min(min_ld, float_type(entries[i].mbr.ld[d]));
+				max_ru = std::max(max_ru, float_type(entries[i].mbr.ru[d]));
+			}
+			if (high_ld == low_ru)
+				low_ru = high_ld == 0 ? 1 : 0;
+			float_type width{ max_ru - min_ld };
+			float_type separation{ float_type(entries[high_ld].mbr.ld[d]) - float_type(entries[low_ru].mbr.ru[d]) };
+			if (width > 0)
+				separation /= width;
+			if (separation > best_separation)
+			{
+				best_separation = separation;
+				s1 = low_ru;
+				s2 = high_ld;
+			}
+		}
+
+		std::array<unsigned char, n> group{};
+		group[s1] = 1;
+		group[s2] = 2;
+		mbr_t m1{ entries[s1].mbr }, m2{ entries[s2].mbr };
+		size_t n1{ 1 }, n2{ 1 }, left{ n - 2 };
+
+		for (size_t i = 0; i < n; i++)
+		{
+			if (group[i])
+				continue;
+			if (n1 + left <= min_nodes || n2 + left <= min_nodes) /*оставшиеся нужны группе для минимального заполнения*/
+			{
+				group[i] = n1 + left <= min_nodes ? 1 : 2;
+			}
+			else
+			{
+				float_type d1{ mbr_area<float_type>(mbr_union(m1, entries[i].mbr)) - mbr_area<float_type>(m1) };
+				float_type d2{ mbr_area<float_type>(mbr_union(m2, entries[i].mbr)) - mbr_area<float_type>(m2) };
+				group[i] = d1 < d2 || (d1 == d2 && n1 <= n2) ? 1 : 2;
+			}
+			if (group[i] == 1)
+			{
+				m1 = mbr_union(m1, entries[i].mbr);
+				n1++;
+			}
+			else
+			{
+				m2 = mbr_union(m2, entries[i].mbr);
+				n2++;
+			}
+			left--;
+		}
+
+		return r_partition(entries, group);
+	}
+};
+
+/*
+Деление для одномерных деревьев (временные интервалы): записи сортируются по началу интервала,
+разрез выбирается с наименьшим перекрытием, затем с наименьшей суммарной длиной;
+при равенстве - самый правый разрез, чтобы при вставке в порядке времени левые узлы оставались заполненными
+*/
+struct R_sorted_policy
+{
+	static constexpr bool forced_reinsert{ false };
+
+	template<typename float_type, typename mbr_source_t, typename mbr_t>
+	static size_t choose_subtree(const mbr_source_t& entry_mbr, size_t count, const mbr_t& mbr, bool /*leaf_children*/)
+	{
+		return r_least_enlargement<float_type>(entry_mbr, count, mbr);
+	}
+
+	template<size_t min_nodes, typename float_type, typename info_t, size_t n>
+	static size_t split(std::array<info_t, n>& entries)
+	{
+		using mbr_t = decltype(info_t::mbr);
+		static_assert(mbr_dims_v<mbr_t> == 1, "R_sorted_policy предназначена для одномерных деревьев");
+		constexpr size_t first_k{ min_nodes > 0 ? min_nodes : 1 };
+		constexpr size_t last_k{ n - first_k };
+
+		std::sort(entries.begin(), entries.end(), [](const info_t& a, const info_t& b)
+			{
+				return a.mbr.ld[0] < b.mbr.ld[0] || (a.mbr.ld[0] == b.mbr.ld[0] && a.mbr.ru[0] < b.mbr.ru[0]);
+			});
+
+		/*после сортировки начало правой группы - начало k-й записи, концы групп - максимумы префикса и суффикса*/
+		std::array<float_type, n> prefix_ru{};
+		prefix_ru[0] = float_type(entries[0].mbr.ru[0]);
+		for (size_t i = 1; i < n; i++)
+			prefix_ru[i] = std::max(prefix_ru[i - 1], float_type(entries[i].mbr.ru[0]));
+		std::array<float_type, n> suffix_ru{};
+		suffix_ru[n - 1] = float_type(entries[n - 1].mbr.ru[0]);
+		for (size_t i = n - 1; i-- > 0;)
+			suffix_ru[i] = std::max(suffix_ru[i + 1], float_type(entries[i].mbr.ru[0]));
+
+		size_t best_k{ last_k };
+		float_type best_overlap{ std::numeric_limits<float_type>::max() };
+		float_type best_length{ std::numeric_limits<float_type>::max() };
+		for (size_t k = last_k + 1; k-- > first_k;)
+		{
+			float_type left_lo{ float_type(entries[0].mbr.ld[0]) }, left_hi{ prefix_ru[k - 1] };
+			float_type right_lo{ float_type(entries[k].mbr.ld[0]) }, right_hi{ suffix_ru[k] };
+			float_type overlap{ std::max(float_type(0), std::min(left_hi, right_hi) - right_lo) };
+			float_type length{ (left_hi - left_lo) + (right_hi - right_lo) };
+			if (overlap < best_overlap || (overlap == best_overlap && length < best_length))
+			{
+				best_overlap = overlap;
+				best_length = length;
+				best_k = k;
+			}
+		}
+		return best_k;
+	}
+};
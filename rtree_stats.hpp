@@ -0,0 +1,259 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+/*
+Статистика обходов R_tree: политика задается параметром шаблона stats_policy
+-R_no_stats (по умолчанию) - счетчиков нет, все вызовы пустые и убираются компилятором
+-R_count_stats - счетчики ведутся в текущем потоке: поиск остается константным и может выполняться
+ из нескольких потоков; счетчики общие для всех деревьев с этой политикой в потоке
+Интерфейс политики:
+-static constexpr bool enabled
+-counters() - накопленные счетчики потока, last() - счетчики последней завершенной операции потока
+-reset() - обнуление накопленных счетчиков
+-scope - объект на время операции: по завершении разница счетчиков записывается в last()
+Форма дерева (R_tree::shape, R_shape) от политики не зависит: это один обход текущего дерева
+*/
+
+/*счетчики*/
+struct R_stats
+{
+	/*просмотренные узлы*/
+	uint64_t nodes_visited{};
+	/*проверенные mbr записей*/
+	uint64_t mbr_tests{};
+	/*объекты листьев, прошедшие проверку*/
+	uint64_t leaf_hits{};
+	/*деления узлов*/
+	uint64_t splits{};
+	/*записи, вставленные заново (после удаления и при повторной вставке R*)*/
+	uint64_t reinserts{};
+	/*переходы от узла к родителю*/
+	uint64_t parent_steps{};
+
+	R_stats& operator+=(const R_stats& other)
+	{
+		this->nodes_visited += other.nodes_visited;
+		this->mbr_tests += other.mbr_tests;
+		this->leaf_hits += other.leaf_hits;
+		this->splits += other.splits;
+		this->reinserts += other.reinserts;
+		this->parent_steps += other.parent_steps;
+		return *this;
+	}
+	R_stats& operator-=(const R_stats& other)
+	{
+		this->nodes_visited -= other.nodes_visited;
+		this->mbr_tests -= other.mbr_tests;
+		this->leaf_hits -= other.leaf_hits;
+		this->splits -= other.splits;
+		this->reinserts -= other.reinserts;
+		this->parent_steps -= other.parent_steps;
+		return *this;
+	}
+	friend R_stats operator+(R_stats a, const R_stats& b)
+	{
+		return a += b;
+	}
+	friend R_stats operator-(R_stats a, const R_stats& b)
+	{
+		return a -= b;
+	}
+};
+
+template<bool enabled_v>
+struct R_stats_policy;
+
+/*статистика выключена*/
+template<>
+struct R_stats_policy<false>
+{
+	static constexpr bool enabled{ false };
+
+	struct scope
+	{
+		scope() {}
+	};
+
+	static R_stats counters()
+	{
+		return R_stats{};
+	}
+	static R_stats last()
+	{
+		return R_stats{};
+	}
+	static void reset()
+	{
+	}
+};
+
+/*счетчики текущего потока*/
+template<>
+struct R_stats_policy<true>
+{
+	static constexpr bool enabled{ true };
+
+	class scope
+	{
+	public:
+		scope()
+			: before(R_stats_policy::counters()) {}
+		~scope()
+		{
+			R_stats_policy::last() = R_stats_policy::counters() - this->before;
+		}
+
+		scope(const scope&) = delete;
+		scope& operator=(const scope&) = delete;
+
+	private:
+		R_stats before;
+	};
+
+	static R_stats& counters()
+	{
+		return current;
+	}
+	static R_stats& last()
+	{
+		return last_operation;
+	}
+	static void reset()
+	{
+		current = R_stats{};
+		last_operation = R_stats{};
+	}
+
+private:
+	static inline thread_local R_stats current{};
+	static inline thread_local R_stats last_operation{};
+};
+
+using R_no_stats = R_stats_policy<false>;
+using R_count_stats = R_stats_policy<true>;
+
+/*
+форма одного уровня дерева; площади - объемы в num_dims измерениях (у отрезков времени - длины)
+-overlap - сумма попарных пересечений mbr записей внутри каждого узла уровня
+-dead_space - площадь mbr узлов, не покрытая записями (объединение записей оценивается
+ как сумма их площадей без попарных пересечений)
+*/
+struct R_level_shape
+{
+	/*узлы уровня*/
+	size_t nodes{};
+	/*записи во всех узлах уровня*/
+	size_t entries{};
+	/*наименьшее число записей в узле, кроме корня*/
+	size_t min_entries{ std::numeric_limits<size_t>::max() };
+	/*узлы, кроме корня, с числом записей меньше min_nodes*/
+	size_t underfull{};
+	/*пересечение записей-соседей*/
+	double overlap{};
+	/*площадь mbr узлов*/
+	double volume{};
+	/*непокрытая площадь узлов*/
+	double dead_space{};
+
+	R_level_shape& operator+=(const R_level_shape& other)
+	{
+		this->nodes += other.nodes;
+		this->entries += other.entries;
+		this->min_entries = std::min(this->min_entries, other.min_entries);
+		this->underfull += other.underfull;
+		this->overlap += other.overlap;
+		this->volume += other.volume;
+		this->dead_space += other.dead_space;
+		return *this;
+	}
+};
+
+/*форма дерева: уровни от листьев (levels[0]) к корню*/
+struct R_shape
+{
+	size_t max_nodes{};
+	size_t min_nodes{};
+	/*число уровней; у нескольких сложенных деревьев - наибольшее*/
+	size_t height{};
+	/*объекты в листьях*/
+	size_t objects{};
+	std::vector<R_level_shape> levels{};
+
+	size_t nodes() const
+	{
+		size_t total{};
+		for (const R_level_shape& level : this->levels)
+			total += level.nodes;
+		return total;
+	}
+	size_t underfull() const
+	{
+		size_t total{};
+		for (const R_level_shape& level : this->levels)
+			total += level.underfull;
+		return total;
+	}
+	/*средняя заполненность узлов (доля от max_nodes): всех и уровня level*/
+	double fill() const
+	{
+		R_level_shape total{};
+		for (const R_level_shape& level : this->levels)
+			total += level;
+		return this->level_fill(total);
+	}
+	double fill(size_t level) const
+	{
+		return this->level_fill(this->levels[level]);
+	}
+	/*наименьшая заполненность узла, кроме корня; дерево из одного корня - его заполненность*/
+	double min_fill() const
+	{
+		size_t least{ std::numeric_limits<size_t>::max() };
+		for (const R_level_shape& level : this->levels)
+			least = std::min(least, level.min_entries);
+		return least != std::numeric_limits<size_t>::max() ? double(least) / double(this->max_nodes) : this->fill();
+	}
+	double overlap() const
+	{
+		double total{};
+		for (const R_level_shape& level : this->levels)
+			total += level.overlap;
+		return total;
+	}
+	/*доля непокрытой площади узлов всех уровней*/
+	double dead_space() const
+	{
+		double dead{}, volume{};
+		for (const R_level_shape& level : this->levels)
+		{
+			dead += level.dead_space;
+			volume += level.volume;
+		}
+		return volume > 0 ? dead / volume : 0.0;
+	}
+
+	/*сложение форм нескольких деревьев (уровни совмещаются от листьев)*/
+	R_shape& operator+=(const R_shape& other)
+	{
+		this->max_nodes = std::max(this->max_nodes, other.max_nodes);
+		this->min_nodes = std::max(this->min_nodes, other.min_nodes);
+		this->height = std::max(this->height, other.height);
+		this->objects += other.objects;
+		if (this->levels.size() < other.levels.size())
+			this->levels.resize(other.levels.size());
+		for (size_t i = 0; i < other.levels.size(); i++)
+			this->levels[i] += other.levels[i];
+		return *this;
+	}
+
+private:
+	double level_fill(const R_level_shape& level) const
+	{
+		return level.nodes ? double(level.entries) / double(level.nodes * this->max_nodes) : 0.0;
+	}
+};
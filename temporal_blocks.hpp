@@ -0,0 +1,558 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <limits>
+#include <iostream>
+#include <functional>
+#include <algorithm>
+#include <utility>
+#include <iterator>
+#include <cstddef>
+
+#include "rtree.hpp"
+
+#define T_template   template<typename data_type, typename coord_type, typename float_type, size_t block_size, typename stats_policy>
+#define T_class_area Temporal_blocks<data_type, coord_type, float_type, block_size, stats_policy>
+
+/*
+Временной индекс ребра из блоков: интервалы лежат в блоках по возрастанию начала (time_in), блоки упорядочены
+между собой; блок хранит наибольший конец (time_out) своих интервалов и наибольший конец всех блоков до него
+-интервал, начинающийся не раньше последнего, дописывается в последний блок (полный - в новый): O(1)
+-опоздавший интервал вставляется внутрь блока, найденного двоичным поиском; переполненный блок делится пополам
+-поиск: первый блок, до которого наибольший конец достигает окна, находится двоичным поиском,
+ дальше блоки просматриваются, пока их начало не правее окна; блоки, которые кончаются раньше окна, пропускаются
+Интерфейс - та часть интерфейса одномерного R_tree, которой пользуется FNR_tree (insert, search, search_batch,
+query_cursor, remove_if, shape, size, print, write_image), поэтому индекс подставляется вместо временного дерева
+*/
+template<
+	typename data_type,
+	typename coord_type,
+	typename float_type,
+	size_t block_size = 64,
+	typename stats_policy = R_no_stats>
+class Temporal_blocks
+{
+public:
+	/*точка и отрезок времени - как у одномерного R_tree*/
+	using point_t = std::array<coord_type, 1>;
+	struct mbr_t
+	{
+		point_t ld;
+		point_t ru;
+	};
+	using entry_t = std::pair<data_type, mbr_t>;
+
+	Temporal_blocks() = default;
+	~Temporal_blocks() = default;
+
+	Temporal_blocks(const Temporal_blocks&) = delete;  /*конструкторы и операторы копирования и переноса удалены*/
+	Temporal_blocks(Temporal_blocks&&) = delete;
+	Temporal_blocks& operator=(const Temporal_blocks&) = delete;
+	Temporal_blocks& operator=(Temporal_blocks&&) = delete;
+
+	/*вставка интервала mbr*/
+	void insert(const data_type& data, const mbr_t& mbr)
+	{
+		typename stats_policy::scope scope{};
+		item_t item{ mbr.ld[0], mbr.ru[0], data };
+
+		if (this->blocks.empty() || item.lo >= this->blocks.back().items.back().lo) /*по порядку: дописываем в конец*/
+		{
+			if (this->blocks.empty() || this->blocks.back().items.size() == block_size)
+			{
+				this->blocks.emplace_back();
+				this->blocks.back().items.reserve(this->blocks.size() == 1 ? 1 : block_size);
+			}
+			block& last{ this->blocks.back() };
+			last.items.push_back(std::move(item));
+			last.max_hi = std::max(last.max_hi, mbr.ru[0]);
+			last.reach = this->blocks.size() > 1 ? std::max(this->blocks[this->blocks.size() - 2].reach, last.max_hi) : last.max_hi;
+			return;
+		}
+
+		/*с опозданием: последний блок, начало которого не правее интервала*/
+		auto found = std::partition_point(this->blocks.begin(), this->blocks.end(), [&item](const block& b)
+			{
+				return b.items.front().lo <= item.lo;
+			});
+		size_t index{ found == this->blocks.begin() ? 0 : size_t(found - this->blocks.begin()) - 1 };
+		std::vector<item_t>& items{ this->blocks[index].items };
+		auto position = std::upper_bound(items.begin(), items.end(), item.lo, [](coord_type lo, const item_t& other)
+			{
+				return lo < other.lo;
+			});
+		items.insert(position, std::move(item));
+		this->blocks[index].max_hi = std::max(this->blocks[index].max_hi, mbr.ru[0]);
+
+		if (items.size() > block_size) /*делим блок пополам*/
+		{
+			block upper{};
+			upper.items.assign(std::make_move_iterator(items.begin() + block_size / 2), std::make_move_iterator(items.end()));
+			items.erase(items.begin() + block_size / 2, items.end());
+			this->recalc_max(this->blocks[index]);
+			this->recalc_max(upper);
+			this->blocks.insert(this->blocks.begin() + index + 1, std::move(upper));
+			count_split();
+		}
+		this->update_reach(index);
+	}
+
+	/*
+	поиск интервалов, удовлетворяющих проверке test с окном mbr (см. mbr_test);
+	visitor(const data_type&) -> bool, false прекращает поиск; возвращает число найденных
+	*/
+	template<typename visitor_t>
+	size_t search(mbr_test test, const mbr_t& mbr, visitor_t&& visitor) const
+	{
+		typename stats_policy::scope scope{};
+		size_t found{};
+		this->scan(test, mbr, [&](const item_t& item)
+			{
+				found++;
+				return visitor(item.data);
+			});
+		return found;
+	}
+	template<typename visitor_t>
+	size_t search_intersecting(const mbr_t& mbr, visitor_t&& visitor) const
+	{
+		return this->search(mbr_test::intersects, mbr, visitor);
+	}
+
+	/*
+	пакетный поиск: каждый блок просматривается один раз для всех запросов, окна которых его задевают;
+	visitor(const data_type&, const std::vector<size_t>& queries) -> bool вызывается один раз на интервал
+	со списком индексов (в windows) подходящих запросов; false прекращает поиск
+	*/
+	template<typename visitor_t>
+	void search_batch(mbr_test test, const std::vector<mbr_t>& windows, visitor_t&& visitor) const
+	{
+		typename stats_policy::scope scope{};
+		if (windows.empty() || this->blocks.empty())
+			return;
+
+		std::vector<bound_t> bounds{};
+		bounds.reserve(windows.size());
+		bound_t all{ bounds_of(test, windows[0]) };
+		for (const mbr_t& window : windows)
+		{
+			bounds.push_back(bounds_of(test, window));
+			all.hi_min = std::min(all.hi_min, bounds.back().hi_min);
+			all.lo_max = std::max(all.lo_max, bounds.back().lo_max);
+		}
+
+		std::vector<size_t> active{}, hits{};
+		for (size_t b = this->first_block(all.hi_min); b < this->blocks.size() && this->blocks[b].items.front().lo <= all.lo_max; b++)
+		{
+			const block& v{ this->blocks[b] };
+			active.clear();
+			for (size_t q = 0; q < windows.size(); q++)
+			{
+				if (v.max_hi >= bounds[q].hi_min && v.items.front().lo <= bounds[q].lo_max)
+					active.push_back(q);
+			}
+			if (active.empty())
+				continue;
+
+			count_visit(v.items.size() * active.size());
+			for (const item_t& item : v.items)
+			{
+				if (item.lo > all.lo_max)
+					break;
+				hits.clear();
+				for (size_t q : active)
+				{
+					if (test_item(test, item, windows[q]))
+						hits.push_back(q);
+				}
+				if (hits.empty())
+					continue;
+				count_hits(1);
+				if (!visitor(item.data, hits))
+					return;
+			}
+		}
+	}
+
+	/*число блоков, которые просматривает поиск с окном mbr (для сравнения с временным R_tree)*/
+	size_t count_visits(mbr_test test, const mbr_t& mbr) const
+	{
+		size_t visits{};
+		bound_t bound{ bounds_of(test, mbr) };
+		for (size_t b = this->first_block(bound.hi_min); b < this->blocks.size() && this->blocks[b].items.front().lo <= bound.lo_max; b++)
+		{
+			visits += this->blocks[b].max_hi >= bound.hi_min;
+		}
+		return visits;
+	}
+
+	/*
+	курсор по интервалам, удовлетворяющим проверке: интервалы выдаются по одному при каждом next();
+	курсор действителен, пока индекс не изменяется
+	*/
+	class query_cursor;
+
+	/*курсор по интервалам, удовлетворяющим проверке test с окном mbr*/
+	query_cursor query(mbr_test test, const mbr_t& mbr) const
+	{
+		query_cursor cursor{};
+		cursor.open(*this, test, mbr);
+		return cursor;
+	}
+
+	/*
+	удаление за один проход интервалов, удовлетворяющих проверке test с окном mbr, для которых
+	predicate(const data_type&) -> bool истинно; пустые блоки убираются; возвращает число удаленных
+	*/
+	template<typename predicate_t>
+	size_t remove_if(mbr_test test, const mbr_t& mbr, predicate_t&& predicate)
+	{
+		typename stats_policy::scope scope{};
+		size_t removed{};
+		bound_t bound{ bounds_of(test, mbr) };
+		for (size_t b = this->first_block(bound.hi_min); b < this->blocks.size() && this->blocks[b].items.front().lo <= bound.lo_max; b++)
+		{
+			block& v{ this->blocks[b] };
+			if (v.max_hi < bound.hi_min)
+				continue;
+			count_visit(v.items.size());
+			auto tail = std::remove_if(v.items.begin(), v.items.end(), [&](const item_t& item)
+				{
+					return item.lo <= bound.lo_max && test_item(test, item, mbr) && predicate(item.data);
+				});
+			removed += size_t(v.items.end() - tail);
+			v.items.erase(tail, v.items.end());
+			this->recalc_max(v);
+		}
+		if (removed)
+		{
+			this->blocks.erase(std::remove_if(this->blocks.begin(), this->blocks.end(), [](const block& v)
+				{
+					return v.items.empty();
+				}), this->blocks.end());
+			this->rebuild_reach();
+		}
+		return removed;
+	}
+
+	/*
+	форма индекса в терминах R_shape: один уровень, узлы - блоки (max_nodes = block_size),
+	пересечение и непокрытая часть считаются по интервалам внутри блока
+	*/
+	R_shape shape() const
+	{
+		R_shape report{ block_size, 0, 1, 0, std::vector<R_level_shape>(1) };
+		R_level_shape& info{ report.levels[0] };
+		for (const block& v : this->blocks)
+		{
+			info.nodes++;
+			info.entries += v.items.size();
+			if (this->blocks.size() > 1)
+				info.min_entries = std::min(info.min_entries, v.items.size());
+
+			double covered{};
+			for (size_t i = 0; i < v.items.size(); i++)
+			{
+				covered += double(v.items[i].hi) - double(v.items[i].lo);
+				for (size_t j = i + 1; j < v.items.size() && v.items[j].lo <= v.items[i].hi; j++) /*дальше начала только правее*/
+				{
+					double overlap{ double(std::min(v.items[i].hi, v.items[j].hi)) - double(v.items[j].lo) };
+					info.overlap += overlap;
+					covered -= overlap;
+				}
+			}
+			double volume{ double(v.max_hi) - double(v.items.front().lo) };
+			info.volume += volume;
+			info.dead_space += std::max(volume - std::max(covered, 0.0), 0.0);
+		}
+		if (this->blocks.empty()) /*пустой индекс - как пустой корень дерева*/
+			info.nodes = 1;
+		report.objects = info.entries;
+		return report;
+	}
+
+	/*память индекса: блоки, интервалы и handler(const data_type&) для каждого объекта*/
+	size_t size(const std::function<size_t(const data_type&)>& handler) const
+	{
+		size_t total{ sizeof(Temporal_blocks) + this->blocks.capacity() * sizeof(block) };
+		for (const block& v : this->blocks)
+		{
+			total += v.items.capacity() * sizeof(item_t);
+			for (const item_t& item : v.items)
+			{
+				total += handler(item.data);
+			}
+		}
+		return total;
+	}
+
+	/*дебаг: вывод блоков*/
+	void print(size_t level = 0, std::function<void(int, void*)> handler_data = {}) const
+	{
+		for (const block& v : this->blocks)
+		{
+			for (size_t l = 0; l < level; l++)
+			{
+				std::cout << "    ";
+			}
+			std::cout << "Блок. [" << v.items.front().lo << ", " << v.max_hi << "]. " << v.items.size() << " интервалов." << std::endl;
+			for (const item_t& item : v.items)
+			{
+				for (size_t l = 0; l < level + 1; l++)
+				{
+					std::cout << "    ";
+				}
+				handler_data(int(level + 1), (void*)&item.data);
+			}
+		}
+	}
+
+	/*
+	запись образа (см. R_tree::write_image): интервалы укладываются в одномерное R-дерево пакетной загрузкой,
+	поэтому образ читается тем же Frozen_R_tree, что и образ временного R_tree
+	*/
+	template<typename convert_t>
+	size_t write_image(std::vector<char>& image, convert_t&& convert) const
+	{
+		using image_tree_t = R_tree<data_type, coord_type, 1, float_type, 8, 4, R_sorted_policy>;
+		std::vector<typename image_tree_t::entry_t> entries{};
+		for (const block& v : this->blocks)
+		{
+			for (const item_t& item : v.items)
+			{
+				entries.push_back({ item.data, { { item.lo }, { item.hi } } });
+			}
+		}
+		image_tree_t tree;
+		tree.bulk_load(entries);
+		return tree.write_image(image, convert);
+	}
+
+	/*статистика обходов (см. rtree_stats.hpp), общая с R_tree той же политики*/
+	static R_stats stats()
+	{
+		return stats_policy::counters();
+	}
+	static R_stats last_stats()
+	{
+		return stats_policy::last();
+	}
+	static void reset_stats()
+	{
+		stats_policy::reset();
+	}
+
+private:
+	/*интервал и его объект*/
+	struct item_t
+	{
+		coord_type lo;
+		coord_type hi;
+		data_type data;
+	};
+	/*блок интервалов по возрастанию начала*/
+	struct block
+	{
+		std::vector<item_t> items{};
+		/*наибольший конец интервалов блока*/
+		coord_type max_hi{ std::numeric_limits<coord_type>::lowest() };
+		/*наибольший конец интервалов этого и всех предыдущих блоков (не убывает)*/
+		coord_type reach{ std::numeric_limits<coord_type>::lowest() };
+	};
+	/*границы просмотра для окна: начало интервала не правее lo_max, конец не левее hi_min*/
+	struct bound_t
+	{
+		coord_type lo_max;
+		coord_type hi_min;
+	};
+
+	std::vector<block> blocks{};
+
+	static bound_t bounds_of(mbr_test test, const mbr_t& mbr)
+	{
+		switch (test)
+		{
+		case mbr_test::inside:
+			return bound_t{ mbr.ru[0], mbr.ld[0] };
+		case mbr_test::covers:
+			return bound_t{ mbr.ld[0], mbr.ru[0] };
+		default:
+			return bound_t{ mbr.ru[0], mbr.ld[0] };
+		}
+	}
+
+	static bool test_item(mbr_test test, const item_t& item, const mbr_t& mbr)
+	{
+		switch (test)
+		{
+		case mbr_test::inside:
+			return mbr.ld[0] <= item.lo && item.hi <= mbr.ru[0];
+		case mbr_test::covers:
+			return item.lo <= mbr.ld[0] && mbr.ru[0] <= item.hi;
+		default:
+			return item.lo <= mbr.ru[0] && mbr.ld[0] <= item.hi;
+		}
+	}
+
+	/*первый блок, до которого (включительно) наибольший конец не левее hi_min*/
+	size_t first_block(coord_type hi_min) const
+	{
+		return size_t(std::partition_point(this->blocks.begin(), this->blocks.end(), [hi_min](const block& v)
+			{
+				return v.reach < hi_min;
+			}) - this->blocks.begin());
+	}
+
+	/*обход подходящих интервалов, visitor(const item_t&) -> bool, false прекращает обход*/
+	template<typename visitor_t>
+	void scan(mbr_test test, const mbr_t& mbr, visitor_t&& visitor) const
+	{
+		bound_t bound{ bounds_of(test, mbr) };
+		for (size_t b = this->first_block(bound.hi_min); b < this->blocks.size() && this->blocks[b].items.front().lo <= bound.lo_max; b++)
+		{
+			const block& v{ this->blocks[b] };
+			if (v.max_hi < bound.hi_min)
+				continue;
+			count_visit(v.items.size());
+			for (const item_t& item : v.items)
+			{
+				if (item.lo > bound.lo_max)
+					break;
+				if (!test_item(test, item, mbr))
+					continue;
+				count_hits(1);
+				if (!visitor(item))
+					return;
+			}
+		}
+	}
+
+	void recalc_max(block& v) const
+	{
+		v.max_hi = std::numeric_limits<coord_type>::lowest();
+		for (const item_t& item : v.items)
+		{
+			v.max_hi = std::max(v.max_hi, item.hi);
+		}
+	}
+
+	/*
+	пересчет reach с блока from, когда max_hi менялся только у блоков from и from + 1 (вставка, деление):
+	дальше блоков, у которых reach не изменился, не идем
+	*/
+	void update_reach(size_t from)
+	{
+		for (size_t b = from; b < this->blocks.size(); b++)
+		{
+			coord_type reach{ b ? std::max(this->blocks[b - 1].reach, this->blocks[b].max_hi) : this->blocks[b].max_hi };
+			if (b > from && reach == this->blocks[b].reach)
+				break;
+			this->blocks[b].reach = reach;
+		}
+	}
+
+	/*полный пересчет reach после изменения max_hi у произвольных блоков (пакетное удаление)*/
+	void rebuild_reach()
+	{
+		for (size_t b = 0; b < this->blocks.size(); b++)
+			this->blocks[b].reach = b ? std::max(this->blocks[b - 1].reach, this->blocks[b].max_hi) : this->blocks[b].max_hi;
+	}
+
+	/*счетчики обходов: блок - как узел, интервал - как проверка mbr*/
+	static void count_visit(size_t entries)
+	{
+		if constexpr (stats_policy::enabled)
+		{
+			stats_policy::counters().nodes_visited++;
+			stats_policy::counters().mbr_tests += entries;
+		}
+	}
+	static void count_hits(size_t hits)
+	{
+		if constexpr (stats_policy::enabled)
+			stats_policy::counters().leaf_hits += hits;
+	}
+	static void count_split()
+	{
+		if constexpr (stats_policy::enabled)
+			stats_policy::counters().splits++;
+	}
+};
+
+T_template
+class T_class_area::query_cursor
+{
+public:
+	query_cursor() = default;
+
+	/*начать новый запрос к индексу tree*/
+	void open(const Temporal_blocks& tree, mbr_test test, const mbr_t& mbr)
+	{
+		this->tree = &tree;
+		this->test = test;
+		this->mbr = mbr;
+		this->bound = bounds_of(test, mbr);
+		this->block_index = tree.first_block(this->bound.hi_min);
+		this->item_index = 0;
+		this->current = nullptr;
+		this->entered = false;
+	}
+
+	/*переход к следующему интервалу, false - интервалов больше нет*/
+	bool next()
+	{
+		this->current = nullptr;
+		if (this->tree == nullptr)
+			return false;
+		const std::vector<block>& blocks{ this->tree->blocks };
+		while (this->block_index < blocks.size() && blocks[this->block_index].items.front().lo <= this->bound.lo_max)
+		{
+			const block& v{ blocks[this->block_index] };
+			if (!this->entered)
+			{
+				if (v.max_hi < this->bound.hi_min)
+				{
+					this->block_index++;
+					continue;
+				}
+				count_visit(v.items.size());
+				this->entered = true;
+			}
+			while (this->item_index < v.items.size() && v.items[this->item_index].lo <= this->bound.lo_max)
+			{
+				const item_t& item{ v.items[this->item_index++] };
+				if (test_item(this->test, item, this->mbr))
+				{
+					count_hits(1);
+					this->current = &item;
+					return true;
+				}
+			}
+			this->block_index++;
+			this->item_index = 0;
+			this->entered = false;
+		}
+		return false;
+	}
+
+	/*текущий интервал и его отрезок (после успешного next())*/
+	const data_type& data() const
+	{
+		return this->current->data;
+	}
+	mbr_t get_mbr() const
+	{
+		return mbr_t{ { this->current->lo }, { this->current->hi } };
+	}
+
+private:
+	const Temporal_blocks* tree{ nullptr };
+	mbr_test test{ mbr_test::intersects };
+	mbr_t mbr{};
+	bound_t bound{};
+	size_t block_index{ 0 };
+	size_t item_index{ 0 };
+	bool entered{ false };
+	const item_t* current{ nullptr };
+};
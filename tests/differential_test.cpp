@@ -0,0 +1,453 @@
+/*
+Сверка индексов с линейным просмотром: каждый запрос выполняется и по индексу, и перебором всех записей,
+результаты должны совпасть. Запуск без аргументов; код возврата 0 - расхождений нет, иначе печатается каждое расхождение
+*/
+#include "../fnrtree.hpp"
+#include "../fnrtree_frozen.hpp"
+#include "../temporal_blocks.hpp"
+
+#include <iostream>
+#include <random>
+#include <set>
+#include <map>
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <cmath>
+
+static size_t failures{};
+
+void check(bool ok, const std::string& what)
+{
+	if (!ok)
+	{
+		failures++;
+		std::cout << "FAIL: " << what << std::endl;
+	}
+}
+
+const mbr_test all_tests[]{ mbr_test::inside, mbr_test::covers, mbr_test::intersects };
+
+/*проверка test записи [lo, hi] с окном [wlo, whi] по одной оси перебором (как R_tree::test_mbr)*/
+template<typename coord_type, size_t num_dims>
+bool scanTest(mbr_test test, const std::array<coord_type, num_dims>& lo, const std::array<coord_type, num_dims>& hi,
+	const std::array<coord_type, num_dims>& wlo, const std::array<coord_type, num_dims>& whi)
+{
+	for (size_t i = 0; i < num_dims; i++)
+	{
+		bool ok{};
+		switch (test)
+		{
+		case mbr_test::inside: ok = wlo[i] <= lo[i] && hi[i] <= whi[i]; break;
+		case mbr_test::covers: ok = lo[i] <= wlo[i] && whi[i] <= hi[i]; break;
+		case mbr_test::intersects: ok = lo[i] <= whi[i] && wlo[i] <= hi[i]; break;
+		}
+		if (!ok)
+			return false;
+	}
+	return true;
+}
+
+/*R_tree с политикой вставки policy_t против перебора записей*/
+template<typename policy_t>
+void checkRtree(const std::string& name, unsigned seed)
+{
+	using tree_t = R_tree<int, int, 2, float, 8, 4, policy_t>;
+	using mbr_t = typename tree_t::mbr_t;
+
+	std::mt19937 gen(seed);
+	std::uniform_int_distribution<int> coord(-5000, 5000), extent(0, 200);
+	auto randomBox = [&]()
+	{
+		int x{ coord(gen) }, y{ coord(gen) };
+		return mbr_t{ { x, y }, { x + extent(gen), y + extent(gen) } };
+	};
+
+	tree_t tree{};
+	std::map<int, mbr_t> boxes{};
+	for (int i = 0; i < 5000; i++)
+	{
+		boxes[i] = randomBox();
+		tree.insert(i, boxes[i]);
+	}
+
+	auto compare = [&](const std::string& stage)
+	{
+		std::vector<mbr_t> windows{};
+		for (int q = 0; q < 100; q++)
+		{
+			mbr_t w{ randomBox() };
+			if (q % 4 == 0)
+				w.ru = w.ld;
+			windows.push_back(w);
+		}
+		for (mbr_test test : all_tests)
+		{
+			std::vector<std::multiset<int>> expected(windows.size()), batch(windows.size());
+			for (size_t q = 0; q < windows.size(); q++)
+			{
+				for (const auto& entry : boxes)
+					if (scanTest<int, 2>(test, entry.second.ld, entry.second.ru, windows[q].ld, windows[q].ru))
+						expected[q].insert(entry.first);
+
+				std::multiset<int> found{}, cursor{};
+				tree.search(test, windows[q], [&found](const int& v) { found.insert(v); return true; });
+				for (const int& v : tree.query(test, windows[q]))
+					cursor.insert(v);
+				check(found == expected[q], name + " " + stage + ": search");
+				check(cursor == expected[q], name + " " + stage + ": query");
+			}
+			tree.search_batch(test, windows, [&batch](const int& v, const std::vector<size_t>& queries)
+				{
+					for (size_t q : queries)
+						batch[q].insert(v);
+					return true;
+				});
+			check(batch == expected, name + " " + stage + ": search_batch");
+
+			auto frozen = tree.freeze();
+			for (size_t q = 0; q < windows.size(); q++)
+			{
+				std::multiset<int> found{};
+				frozen.search(test, { windows[q].ld, windows[q].ru }, [&found](const int& v) { found.insert(v); return true; });
+				check(found == expected[q], name + " " + stage + ": frozen search");
+			}
+		}
+
+		for (int q = 0; q < 20; q++)
+		{
+			typename tree_t::point_t p{ coord(gen), coord(gen) };
+			std::vector<double> expected{};
+			for (const auto& entry : boxes)
+			{
+				double dist{};
+				for (size_t i = 0; i < 2; i++)
+				{
+					double delta{ std::max({ double(entry.second.ld[i]) - p[i], double(p[i]) - entry.second.ru[i], 0.0 }) };
+					dist += delta * delta;
+				}
+				expected.push_back(std::sqrt(dist));
+			}
+			std::sort(expected.begin(), expected.end());
+			expected.resize(std::min<size_t>(10, expected.size()));
+
+			std::vector<double> found{};
+			tree.template nearest<double>(p, 10, [&found](const int&, double dist) { found.push_back(dist); return true; });
+			bool same{ found.size() == expected.size() };
+			for (size_t i = 0; same && i < found.size(); i++)
+				same = std::fabs(found[i] - expected[i]) < 1e-6;
+			check(same, name + " " + stage + ": nearest");
+		}
+	};
+
+	compare("insert");
+
+	for (int k = 0; k < 2000; k++)
+	{
+		int i{ int(gen() % boxes.size()) };
+		mbr_t moved{ boxes[i] };
+		if (k % 2)
+			moved.ru[0] += extent(gen) / 10;
+		else
+			moved = randomBox();
+		check(tree.update(i, boxes[i], moved), name + ": update of a stored entry");
+		boxes[i] = moved;
+	}
+	check(!tree.update(-1, boxes[0], boxes[0]), name + ": update of a missing entry");
+	compare("update");
+
+	std::vector<typename tree_t::entry_t> batch{};
+	for (const auto& entry : boxes)
+		if (entry.first % 3 == 0)
+			batch.push_back({ entry.first, entry.second });
+	check(tree.remove_batch(batch) == batch.size(), name + ": remove_batch count");
+	for (const auto& entry : batch)
+		boxes.erase(entry.first);
+	compare("remove_batch");
+
+	mbr_t window{ { -2500, -2500 }, { 2500, 2500 } };
+	size_t expected{};
+	for (auto it = boxes.begin(); it != boxes.end();)
+	{
+		if (it->first % 2 == 0 && scanTest<int, 2>(mbr_test::inside, it->second.ld, it->second.ru, window.ld, window.ru))
+		{
+			it = boxes.erase(it);
+			expected++;
+		}
+		else
+			++it;
+	}
+	check(tree.remove_if(mbr_test::inside, window, [](const int& v) { return v % 2 == 0; }) == expected, name + ": remove_if count");
+	compare("remove_if");
+}
+
+/*Temporal_blocks: интервалы с запаздывающими входами, поиск, курсор, пакет и remove_if*/
+void checkTemporalBlocks(unsigned seed)
+{
+	using blocks_t = Temporal_blocks<int, double, float, 16, R_no_stats>;
+	using mbr_t = blocks_t::mbr_t;
+
+	std::mt19937 gen(seed);
+	std::uniform_real_distribution<double> step(0.0, 2.0), duration(0.5, 30.0);
+	blocks_t blocks{};
+	std::map<int, mbr_t> intervals{};
+	double now{};
+	for (int i = 0; i < 8000; i++)
+	{
+		now += step(gen);
+		double lo{ gen() % 10 == 0 ? now - duration(gen) * 10 : now };
+		double hi{ gen() % 50 == 0 ? lo + 1000 : lo + duration(gen) }; /*редкие длинные интервалы держат reach*/
+		intervals[i] = { { lo }, { hi } };
+		blocks.insert(i, intervals[i]);
+	}
+
+	auto compare = [&](const std::string& stage)
+	{
+		std::uniform_real_distribution<double> start(-50.0, now + 50.0), width(0.0, 60.0);
+		std::vector<mbr_t> windows{};
+		for (int q = 0; q < 150; q++)
+		{
+			double a{ start(gen) };
+			windows.push_back({ { a }, { a + (q % 3 ? width(gen) : 0.0) } });
+		}
+		for (mbr_test test : all_tests)
+		{
+			std::vector<std::multiset<int>> expected(windows.size()), batch(windows.size());
+			for (size_t q = 0; q < windows.size(); q++)
+			{
+				for (const auto& entry : intervals)
+					if (scanTest<double, 1>(test, entry.second.ld, entry.second.ru, windows[q].ld, windows[q].ru))
+						expected[q].insert(entry.first);
+
+				std::multiset<int> found{}, cursor{};
+				blocks.search(test, windows[q], [&found](const int& v) { found.insert(v); return true; });
+				auto it = blocks.query(test, windows[q]);
+				while (it.next())
+					cursor.insert(it.data());
+				check(found == expected[q], "Temporal_blocks " + stage + ": search");
+				check(cursor == expected[q], "Temporal_blocks " + stage + ": query");
+			}
+			blocks.search_batch(test, windows, [&batch](const int& v, const std::vector<size_t>& queries)
+				{
+					for (size_t q : queries)
+						batch[q].insert(v);
+					return true;
+				});
+			check(batch == expected, "Temporal_blocks " + stage + ": search_batch");
+		}
+		check(blocks.shape().objects == intervals.size(), "Temporal_blocks " + stage + ": shape objects");
+	};
+
+	compare("insert");
+
+	for (int round = 0; round < 3; round++)
+	{
+		mbr_t window{ { -1e9 }, { now * (round + 1) / 4 } };
+		size_t expected{};
+		for (auto it = intervals.begin(); it != intervals.end();)
+		{
+			if ((it->first + round) % 3 != 0 && scanTest<double, 1>(mbr_test::inside, it->second.ld, it->second.ru, window.ld, window.ru))
+			{
+				it = intervals.erase(it);
+				expected++;
+			}
+			else
+				++it;
+		}
+		check(blocks.remove_if(mbr_test::inside, window, [round](const int& v) { return (v + round) % 3 != 0; }) == expected, "Temporal_blocks: remove_if count");
+		compare("remove_if " + std::to_string(round));
+	}
+}
+
+/*перемещение по ребру для линейного просмотра*/
+struct Scan_move
+{
+	long object;
+	size_t edge;
+	double time_in, time_out;
+};
+
+/*
+FNR_tree с временным индексом temporal_policy против перебора перемещений;
+сеть лежит в квадрате со стороной 2000 от origin (большие координаты не помещаются в точность float)
+*/
+template<typename temporal_policy>
+void checkFnrTree(const std::string& name, unsigned seed, int origin)
+{
+	using fnr_t = FNR_tree<long, R_no_stats, temporal_policy>;
+
+	std::mt19937 gen(seed);
+	std::uniform_int_distribution<int> coord(origin, origin + 2000), extent(-60, 60);
+	std::uniform_real_distribution<double> time(0.0, 1000.0);
+
+	/*ребра с различными отрезками; разреженные идентификаторы проверяют хеш идентификаторов*/
+	std::vector<std::array<int, 4>> edges{};
+	std::set<std::array<int, 4>> lines{};
+	std::vector<typename fnr_t::Network_edge> network{};
+	while (edges.size() < 1500)
+	{
+		int x1{ coord(gen) }, y1{ coord(gen) }, x2{ x1 + extent(gen) }, y2{ y1 + extent(gen) };
+		if ((x1 == x2 && y1 == y2) || !lines.insert({ std::min(x1, x2), std::min(y1, y2), std::max(x1, x2), std::max(y1, y2) }).second)
+			continue;
+		network.emplace_back(7919LL * long(edges.size()) + (1LL << 40), x1, y1, x2, y2, "e" + std::to_string(edges.size()));
+		edges.push_back({ x1, y1, x2, y2 });
+	}
+	fnr_t tree{};
+	tree.load_network(network);
+	/*повторный идентификатор остается за первым ребром; у второго ребра нет перемещений*/
+	tree.insert_line(network[0].id, origin - 100, origin - 100, origin - 90, origin - 100, "duplicate");
+
+	std::vector<Scan_move> moves{};
+	for (int i = 0; i < 20000; i++)
+	{
+		size_t e{ gen() % edges.size() };
+		const std::array<int, 4>& s{ edges[e] };
+		double in{ time(gen) }, out{ in + time(gen) / 50 };
+		long object{ long(i % 400) };
+		if (i % 2)
+		{
+			tree.insert_trip_segment(object, s[0], s[1], s[2], s[3], in, out);
+		}
+		else
+		{
+			bool direction{ s[0] != s[2] ? s[0] > s[2] : s[1] > s[3] };
+			tree.insert_trip_segment(object, network[e].id, in, out, direction);
+		}
+		moves.push_back({ object, e, in, out });
+	}
+	tree.insert_trip_segment(0, network[0].id, 10.0, 20.0, false);
+	moves.push_back({ 0, 0, 10.0, 20.0 });
+	tree.insert_trip_segment(0, 12345LL, 0.0, 1.0, false); /*неизвестные идентификаторы пропускаются*/
+	tree.insert_trip_segment(0, fnr_t::no_edge, 0.0, 1.0, false);
+
+	/*отрезок ребра так, как его восстанавливает FNR_tree::edge_segment*/
+	auto segment = [&edges](size_t e)
+	{
+		const std::array<int, 4>& s{ edges[e] };
+		int minX{ std::min(s[0], s[2]) }, maxX{ std::max(s[0], s[2]) }, minY{ std::min(s[1], s[3]) }, maxY{ std::max(s[1], s[3]) };
+		bool orientation{ !((s[2] - s[0]) * (s[3] - s[1]) >= 0) };
+		return orientation ? std::array<int, 4>{ minX, maxY, maxX, minY } : std::array<int, 4>{ minX, minY, maxX, maxY };
+	};
+	auto scanSearch = [&](const typename fnr_t::Search_query& q, mbr_test spatialTest, mbr_test temporalTest)
+	{
+		std::array<int, 2> wlo{ std::min(q.x1, q.x2), std::min(q.y1, q.y2) }, whi{ std::max(q.x1, q.x2), std::max(q.y1, q.y2) };
+		std::set<long> found{};
+		for (const Scan_move& m : moves)
+		{
+			std::array<int, 4> p{ segment(m.edge) };
+			std::array<int, 2> lo{ p[0], std::min(p[1], p[3]) }, hi{ p[2], std::max(p[1], p[3]) };
+			if (scanTest<int, 2>(spatialTest, lo, hi, wlo, whi)
+				&& fnr_t::segment_intersect_rectangle(wlo[0], wlo[1], whi[0], whi[1], p[0], p[1], p[2], p[3])
+				&& scanTest<double, 1>(temporalTest, { m.time_in }, { m.time_out }, { q.entrance_time }, { q.exit_time }))
+				found.insert(m.object);
+		}
+		return found;
+	};
+
+	Thread_pool pool(4);
+	auto compare = [&](const std::string& stage)
+	{
+		std::vector<typename fnr_t::Search_query> queries{};
+		std::vector<typename Frozen_FNR_tree<long>::Search_query> frozenQueries{};
+		for (int q = 0; q < 200; q++)
+		{
+			int x{ coord(gen) }, y{ coord(gen) }, d{ q % 4 ? 100 : 0 };
+			double t{ time(gen) };
+			queries.emplace_back(x, y, x + d, y + d, t, t + (q % 2 ? 50.0 : 1.0));
+			frozenQueries.emplace_back(x, y, x + d, y + d, t, t + (q % 2 ? 50.0 : 1.0));
+		}
+		Frozen_FNR_tree<long> frozen{};
+		check(frozen.load(tree), name + " " + stage + ": frozen load");
+
+		for (mbr_test spatialTest : all_tests)
+			for (mbr_test temporalTest : all_tests)
+			{
+				std::vector<std::set<long>> expected{};
+				for (const auto& q : queries)
+					expected.push_back(scanSearch(q, spatialTest, temporalTest));
+
+				std::string what{ name + " " + stage + " " + std::to_string(int(spatialTest)) + "/" + std::to_string(int(temporalTest)) + ": " };
+				check(tree.search_batch(queries, spatialTest, temporalTest) == expected, what + "search_batch");
+				check(tree.search_parallel(queries, pool, spatialTest, temporalTest) == expected, what + "search_parallel");
+				check(frozen.search_batch(frozenQueries, spatialTest, temporalTest) == expected, what + "Frozen_FNR_tree search_batch");
+				check(frozen.search_parallel(frozenQueries, pool, spatialTest, temporalTest) == expected, what + "Frozen_FNR_tree search_parallel");
+				for (size_t q = 0; q < 20; q++)
+				{
+					std::set<long> found{}, cursor{};
+					tree.search(queries[q].x1, queries[q].y1, queries[q].x2, queries[q].y2, queries[q].entrance_time, queries[q].exit_time, &found, spatialTest, temporalTest);
+					for (const auto& hit : tree.query(queries[q].x1, queries[q].y1, queries[q].x2, queries[q].y2, queries[q].entrance_time, queries[q].exit_time, spatialTest, temporalTest))
+						cursor.insert(hit.object_id);
+					check(found == expected[q], what + "search");
+					check(cursor == expected[q], what + "query");
+				}
+			}
+
+		for (int q = 0; q < 20; q++)
+		{
+			int x{ coord(gen) }, y{ coord(gen) };
+			double t{ time(gen) };
+			size_t k{ 1 + gen() % 15 };
+			std::map<long, double> best{};
+			for (const Scan_move& m : moves)
+			{
+				if (m.time_out < t || t + 50 < m.time_in)
+					continue;
+				std::array<int, 4> p{ segment(m.edge) };
+				double dx{ double(p[2]) - p[0] }, dy{ double(p[3]) - p[1] }, len2{ dx * dx + dy * dy };
+				double u{ len2 > 0 ? std::clamp(((double(x) - p[0]) * dx + (double(y) - p[1]) * dy) / len2, 0.0, 1.0) : 0.0 };
+				double ex{ p[0] + u * dx - x }, ey{ p[1] + u * dy - y }, dist{ std::sqrt(ex * ex + ey * ey) };
+				auto it = best.find(m.object);
+				if (it == best.end() || dist < it->second)
+					best[m.object] = dist;
+			}
+			std::vector<double> expected{};
+			for (const auto& entry : best)
+				expected.push_back(entry.second);
+			std::sort(expected.begin(), expected.end());
+			expected.resize(std::min(k, expected.size()));
+
+			std::vector<std::pair<long, double>> found{ tree.nearest_objects(x, y, k, t, t + 50) };
+			bool same{ found.size() == expected.size() };
+			for (size_t i = 0; same && i < found.size(); i++)
+				same = std::fabs(found[i].second - expected[i]) < 1e-6 && std::fabs(best[found[i].first] - found[i].second) < 1e-6;
+			check(same, name + " " + stage + ": nearest_objects");
+		}
+	};
+
+	compare("insert");
+
+	size_t expected{};
+	for (auto it = moves.begin(); it != moves.end();)
+	{
+		if (it->object == 17 || it->object == 42)
+		{
+			it = moves.erase(it);
+			expected++;
+		}
+		else
+			++it;
+	}
+	check(tree.remove_object(17) + tree.remove_object(42) == expected, name + ": remove_object count");
+	compare("remove_object");
+
+	expected = size_t(std::count_if(moves.begin(), moves.end(), [](const Scan_move& m) { return m.time_out < 400; }));
+	moves.erase(std::remove_if(moves.begin(), moves.end(), [](const Scan_move& m) { return m.time_out < 400; }), moves.end());
+	check(tree.remove_before(400) == expected, name + ": remove_before count");
+	compare("remove_before");
+	check(tree.shape().intervals == moves.size(), name + ": shape intervals");
+}
+
+int main()
+{
+	checkRtree<R_quadratic_policy>("R_tree<quadratic>", 1);
+	checkRtree<R_linear_policy>("R_tree<linear>", 2);
+	checkRtree<R_rstar_policy>("R_tree<rstar>", 3);
+	checkTemporalBlocks(4);
+	checkFnrTree<FNR_rtree_temporal>("FNR_tree<rtree temporal>", 5, 0);
+	checkFnrTree<FNR_blocked_temporal>("FNR_tree<blocked temporal>", 6, 0);
+	checkFnrTree<FNR_rtree_temporal>("FNR_tree<rtree temporal, far origin>", 7, 2000000000);
+
+	std::cout << (failures ? "differential test FAILED: " : "differential test passed: ") << failures << " mismatches" << std::endl;
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+
+/*
+Пул потоков с перехватом задач (work stealing)
+У каждого потока своя очередь: свои задачи берутся с конца, при пустой очереди
+задачи перехватываются с начала очередей других потоков.
+Задачи, добавленные из потока пула, попадают в его очередь, остальные распределяются по кругу.
+wait() вызывается только извне пула
+*/
+class Thread_pool
+{
+public:
+	using task_t = std::function<void()>;
+
+	explicit Thread_pool(size_t threads = std::thread::hardware_concurrency())
+	{
+		threads = std::max<size_t>(threads, 1);
+		for (size_t i = 0; i < threads; i++)
+		{
+			this->queues.push_back(std::make_unique<worker_queue>());
+		}
+		for (size_t i = 0; i < threads; i++)
+		{
+			this->workers.emplace_back([this, i] { this->run(i); });
+		}
+	}
+	~Thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(this->wake_mutex);
+			this->stop = true;
+		}
+		this->wake.notify_all();
+		for (std::thread& worker : this->workers)
+		{
+			worker.join();
+		}
+	}
+
+	Thread_pool(const Thread_pool&) = delete;  /*конструкторы и операторы копирования и переноса удалены*/
+	Thread_pool(Thread_pool&&) = delete;
+	Thread_pool& operator=(const Thread_pool&) = delete;
+	Thread_pool& operator=(Thread_pool&&) = delete;
+
+	/*количество потоков*/
+	size_t size() const
+	{
+		return this->workers.size();
+	}
+
+	/*добавление задачи*/
+	void submit(task_t task)
+	{
+		size_t index{ current_pool == this ? current_index : this->next_queue++ % this->queues.size() };
+		{
+			/*счетчики растут до того, как задачу увидят потоки: иначе ее могут выполнить и уменьшить счетчики раньше*/
+			std::lock_guard<std::mutex> lock(this->wake_mutex);
+			this->queued++;
+			this->pending++;
+		}
+		{
+			std::lock_guard<std::mutex> lock(this->queues[index]->mutex);
+			this->queues[index]->tasks.push_back(std::move(task));
+		}
+		this->wake.notify_one();
+	}
+
+	/*ожидание выполнения всех добавленных задач*/
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock(this->wake_mutex);
+		this->done.wait(lock, [this] { return this->pending == 0; });
+	}
+
+	/*f(begin, end) для отрезков [0, count) длины chunk, возврат после выполнения всех отрезков*/
+	template<typename function_t>
+	void parallel_for(size_t count, size_t chunk, const function_t& f)
+	{
+		chunk = std::max<size_t>(chunk, 1);
+		for (size_t begin = 0; begin < count; begin += chunk)
+		{
+			size_t end{ std::min(count, begin + chunk) };
+			this->submit([&f, begin, end] { f(begin, end); });
+		}
+		this->wait();
+	}
+
+private:
+	struct worker_queue
+	{
+		std::mutex mutex;
+		std::deque<task_t> tasks;
+	};
+
+	/*поток пула, в котором выполняется код (для submit из задачи)*/
+	static inline thread_local const Thread_pool* current_pool{ nullptr };
+	static inline thread_local size_t current_index{ 0 };
+
+	std::vector<std::unique_ptr<worker_queue>> queues{};
+	std::vector<std::thread> workers{};
+	std::atomic<size_t> next_queue{ 0 };
+
+	std::mutex wake_mutex{};
+	std::condition_variable wake{};
+	std::condition_variable done{};
+	size_t queued{ 0 };  /*задачи в очередях (под wake_mutex)*/
+	size_t pending{ 0 }; /*задачи, которые еще не выполнены (под wake_mutex)*/
+	bool stop{ false };
+
+	void run(size_t index)
+	{
+		current_pool = this;
+		current_index = index;
+
+		while (true)
+		{
+			task_t task{};
+			if (this->pop(index, task))
+			{
+				task();
+				std::lock_guard<std::mutex> lock(this->wake_mutex);
+				if (--this->pending == 0)
+					this->done.notify_all();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(this->wake_mutex);
+			this->wake.wait(lock, [this] { return this->stop || this->queued > 0; });
+			if (this->stop && this->queued == 0)
+				return;
+		}
+	}
+
+	/*своя задача с конца очереди или перехват чужой с начала*/
+	bool pop(size_t index, task_t& task)
+	{
+		for (size_t k = 0; k < this->queues.size(); k++)
+		{
+			worker_queue& queue{ *this->queues[(index + k) % this->queues.size()] };
+			std::unique_lock<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty())
+				continue;
+			if (k == 0)
+			{
+				task = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+			else
+			{
+				task = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+			}
+			lock.unlock();
+
+			std::lock_guard<std::mutex> wake_lock(this->wake_mutex);
+			this->queued--;
+			return true;
+		}
+		return false;
+	}
+};